@@ -0,0 +1,303 @@
+// Copyright (C) 2020 Ash Logan <ash@heyquark.com>
+// Licensed under the terms of the GNU GPL, version 3
+// http://www.gnu.org/licenses/gpl-3.0.txt
+
+#include "rpx.hpp"
+#include "synthetic.hpp"
+
+#include <benchmark/benchmark.h>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <streambuf>
+#include <cstring>
+
+namespace {
+
+//an ostream into a preallocated buffer that, unlike stringstream, lets
+//writerpx seek past the end of what's been written so far
+class memory_buf : public std::streambuf {
+public:
+	memory_buf(size_t size) : buffer(size) {}
+protected:
+	std::streamsize xsputn(const char* s, std::streamsize n) override {
+		if (pos + n > (off_type)buffer.size()) buffer.resize(pos + n);
+		memcpy(buffer.data() + pos, s, n);
+		pos += n;
+		return n;
+	}
+	int_type overflow(int_type c) override {
+		char ch = traits_type::to_char_type(c);
+		xsputn(&ch, 1);
+		return traits_type::not_eof(c);
+	}
+	pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode) override {
+		if (dir == std::ios_base::beg) pos = off;
+		else if (dir == std::ios_base::cur) pos += off;
+		else pos = buffer.size() + off;
+		return pos;
+	}
+	pos_type seekpos(pos_type p, std::ios_base::openmode) override {
+		pos = p;
+		return pos;
+	}
+private:
+	std::vector<char> buffer;
+	off_type pos = 0;
+};
+
+//the inputs are slow to make, so only make each size once
+struct inputs {
+	rpx::rpx decompressed;
+	rpx::rpx compressed;
+	std::string file;
+	std::filesystem::path path;
+};
+
+const inputs& get_inputs(size_t mb) {
+	static std::map<size_t, inputs> cache;
+	auto it = cache.find(mb);
+	if (it != cache.end()) return it->second;
+
+	inputs in;
+	in.decompressed = synthetic::make_rpx(mb * 1000 * 1000);
+	in.compressed = in.decompressed;
+	rpx::compress(in.compressed);
+
+	std::vector<uint8_t> file(rpx::writerpxsize(in.compressed));
+	rpx::writerpx(in.compressed, file);
+	in.file.assign(file.begin(), file.end());
+
+	in.path = std::filesystem::temp_directory_path() / ("wiiurpx_bench_" + std::to_string(mb) + "mb.rpx");
+	std::ofstream(in.path, std::ios::binary).write(in.file.data(), in.file.size());
+
+	return cache.emplace(mb, std::move(in)).first->second;
+}
+
+size_t data_size(const rpx::rpx& elf) {
+	size_t size = 0;
+	for (const auto& section : elf.sections) size += section.data.size();
+	return size;
+}
+
+//reports throughput in MB/s (10^6, not MiB). shows up as "MB=123/s"
+void set_throughput(benchmark::State& state, size_t bytes) {
+	state.counters["MB"] = benchmark::Counter(
+		(double)bytes * state.iterations() / 1e6, benchmark::Counter::kIsRate);
+}
+
+void BM_readrpx(benchmark::State& state) {
+	const auto& in = get_inputs(state.range(0));
+	for (auto _ : state) {
+		std::istringstream is(in.file);
+		auto elf = rpx::readrpx(is);
+		benchmark::DoNotOptimize(elf);
+	}
+	set_throughput(state, in.file.size());
+}
+
+void BM_maprpx(benchmark::State& state) {
+	const auto& in = get_inputs(state.range(0));
+	for (auto _ : state) {
+		auto elf = rpx::maprpx(in.path);
+		benchmark::DoNotOptimize(elf);
+	}
+	set_throughput(state, in.file.size());
+}
+
+void BM_decompress(benchmark::State& state) {
+	const auto& in = get_inputs(state.range(0));
+	for (auto _ : state) {
+		state.PauseTiming();
+		auto elf = in.compressed;
+		state.ResumeTiming();
+		rpx::decompress(elf, { .threads = (unsigned int)state.range(1) });
+		benchmark::DoNotOptimize(elf);
+	}
+	set_throughput(state, data_size(in.decompressed));
+}
+
+void BM_verify_crcs(benchmark::State& state) {
+	const auto& in = get_inputs(state.range(0));
+	for (auto _ : state) {
+		auto mismatches = rpx::verify_crcs(in.compressed, { .threads = (unsigned int)state.range(1) });
+		benchmark::DoNotOptimize(mismatches);
+	}
+	set_throughput(state, data_size(in.decompressed));
+}
+
+void BM_compress(benchmark::State& state) {
+	const auto& in = get_inputs(state.range(0));
+	for (auto _ : state) {
+		state.PauseTiming();
+		auto elf = in.decompressed;
+		state.ResumeTiming();
+		rpx::compress(elf, { .threads = (unsigned int)state.range(1) });
+		benchmark::DoNotOptimize(elf);
+	}
+	set_throughput(state, data_size(in.decompressed));
+}
+
+void BM_relink(benchmark::State& state) {
+	const auto& in = get_inputs(state.range(0));
+	auto elf = in.decompressed;
+	for (auto _ : state) {
+		rpx::relink(elf);
+		benchmark::ClobberMemory();
+	}
+	//relink only looks at headers, so the amount of data doesn't matter
+	state.SetItemsProcessed(state.iterations() * elf.sections.size());
+}
+
+void BM_relocate(benchmark::State& state) {
+	const auto& in = get_inputs(state.range(0));
+	auto elf = in.decompressed;
+	//move .text and .data, like loading it somewhere else would
+	rpx::relocate_options options;
+	for (const auto& section : elf.sections) options.section_addresses.push_back(section.hdr.sh_addr);
+	options.section_addresses[1] += 0x100000;
+	options.section_addresses[4] += 0x100000;
+	size_t relocs = 0;
+	for (const auto& section : elf.sections) {
+		if (section.hdr.sh_type == rpx::SHT_RELA) relocs += section.data.size() / sizeof(rpx::Elf32_Rela);
+	}
+	for (auto _ : state) {
+		rpx::relocate(elf, options);
+		benchmark::ClobberMemory();
+	}
+	state.SetItemsProcessed(state.iterations() * relocs);
+}
+
+//a nightly build's worth of change - a few bytes of every big section
+void BM_patch(benchmark::State& state) {
+	const auto& in = get_inputs(state.range(0));
+	auto next = in.decompressed;
+	for (auto& section : next.sections) {
+		if (section.data.size() < 0x10000) continue;
+		for (size_t i = 0; i < section.data.size(); i += 0x10000) section.data[i] ^= 0xFF;
+	}
+	auto patch = rpx::diff(in.decompressed, next);
+	for (auto _ : state) {
+		auto elf = rpx::patch(in.decompressed, patch);
+		benchmark::DoNotOptimize(elf);
+	}
+	set_throughput(state, data_size(in.decompressed));
+}
+
+void BM_writerpx(benchmark::State& state) {
+	const auto& in = get_inputs(state.range(0));
+	memory_buf buf(in.file.size());
+	std::ostream os(&buf);
+	for (auto _ : state) {
+		os.seekp(0);
+		rpx::writerpx(in.compressed, os);
+	}
+	set_throughput(state, in.file.size());
+}
+
+void BM_writerpx_span(benchmark::State& state) {
+	const auto& in = get_inputs(state.range(0));
+	std::vector<uint8_t> out(rpx::writerpxsize(in.compressed));
+	for (auto _ : state) {
+		rpx::writerpx(in.compressed, out);
+		benchmark::ClobberMemory();
+	}
+	set_throughput(state, out.size());
+}
+
+//writerpx_compressed should give the same file as compress() and writerpx()
+//with the same options - no point timing it if it doesn't
+bool matches_compress(const rpx::rpx& elf, const rpx::compress_options& options) {
+	auto compressed = elf;
+	rpx::compress(compressed, options);
+	std::vector<uint8_t> expected(rpx::writerpxsize(compressed));
+	rpx::writerpx(compressed, expected);
+
+	std::ostringstream os;
+	rpx::writerpx_compressed(elf, os, options);
+	auto written = os.str();
+	return written.size() == expected.size() && memcmp(written.data(), expected.data(), written.size()) == 0;
+}
+
+void writerpx_compressed(benchmark::State& state, const rpx::compress_options& options) {
+	const auto& in = get_inputs(state.range(0));
+	if (!matches_compress(in.decompressed, options)) {
+		state.SkipWithError("output doesn't match compress() + writerpx()!");
+		return;
+	}
+	memory_buf buf(in.file.size());
+	std::ostream os(&buf);
+	for (auto _ : state) {
+		os.seekp(0);
+		rpx::writerpx_compressed(in.decompressed, os, options);
+	}
+	set_throughput(state, data_size(in.decompressed));
+}
+
+void BM_writerpx_compressed(benchmark::State& state) {
+	writerpx_compressed(state, { .threads = (unsigned int)state.range(1) });
+}
+
+//with the big sections split into blocks, like compress() would
+void BM_writerpx_compressed_split(benchmark::State& state) {
+	writerpx_compressed(state, { .threads = (unsigned int)state.range(1), .block_threshold = 256 * 1024 });
+}
+
+void BM_crc32(benchmark::State& state) {
+	std::vector<uint8_t> data(state.range(0) * 1000 * 1000);
+	std::mt19937 rng(1);
+	for (auto& b : data) b = rng();
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(rpx::crc32(0, data));
+	}
+	set_throughput(state, data.size());
+}
+
+//a symbol table's worth of Elf32_Syms to native order, all at once
+void BM_from_be_sym(benchmark::State& state) {
+	std::vector<rpx::Elf32_Sym> syms(state.range(0) * 1000 * 1000 / sizeof(rpx::Elf32_Sym));
+	std::vector<rpx::native::Elf32_Sym> out(syms.size());
+	std::mt19937 rng(1);
+	for (auto& b : std::span((uint8_t*)syms.data(), syms.size() * sizeof(rpx::Elf32_Sym))) b = rng();
+	for (auto _ : state) {
+		rpx::from_be(syms, out);
+		benchmark::ClobberMemory();
+	}
+	set_throughput(state, syms.size() * sizeof(rpx::Elf32_Sym));
+}
+
+//sizes in MB
+#define SIZES ->Arg(1)->Arg(10)->Arg(100)
+//sizes in MB, thread counts (0 = every core)
+#define SIZES_THREADS ->ArgsProduct({ { 1, 10, 100 }, { 1, 0 } })->ArgNames({ "MB", "threads" })
+
+BENCHMARK(BM_readrpx) SIZES ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_maprpx) SIZES ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_decompress) SIZES_THREADS ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_verify_crcs) SIZES_THREADS ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_compress) SIZES_THREADS ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_relink) SIZES ->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_relocate) SIZES ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_patch) SIZES ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_writerpx) SIZES ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_writerpx_span) SIZES ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_writerpx_compressed) SIZES_THREADS ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_writerpx_compressed_split) SIZES_THREADS ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_crc32) SIZES ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_from_be_sym) SIZES ->Unit(benchmark::kMillisecond);
+
+}
+
+int main(int argc, char** argv) {
+	benchmark::AddCustomContext("wiiurpx backend", rpx::compression_backend());
+	benchmark::AddCustomContext("wiiurpx crc32", rpx::crc32_engine());
+	benchmark::AddCustomContext("wiiurpx byteswap", rpx::byteswap_engine());
+
+	benchmark::Initialize(&argc, argv);
+	if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+	benchmark::RunSpecifiedBenchmarks();
+	benchmark::Shutdown();
+	return 0;
+}
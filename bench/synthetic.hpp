@@ -0,0 +1,251 @@
+// Copyright (C) 2020 Ash Logan <ash@heyquark.com>
+// Licensed under the terms of the GNU GPL, version 3
+// http://www.gnu.org/licenses/gpl-3.0.txt
+
+#pragma once
+
+//builds fake, but plausible, rpx files in memory so there's something to
+//benchmark without needing real (copyrighted) ones
+
+#include "rpx.hpp"
+#include <cstdint>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace synthetic {
+
+//the bits of a section we care about when making one up
+struct section_desc {
+	const char* name;
+	uint32_t type;
+	uint32_t flags;
+	uint32_t addr;
+	//share of the total file size
+	double share;
+	enum { NONE, TEXT, RODATA, DATA, SYMTAB, STRTAB, RELA, SHSTRTAB, CRCS, FILEINFO } kind;
+};
+
+static void put_be32(std::vector<uint8_t>& v, size_t offset, uint32_t value) {
+	v[offset + 0] = value >> 24;
+	v[offset + 1] = value >> 16;
+	v[offset + 2] = value >> 8;
+	v[offset + 3] = value >> 0;
+}
+
+//powerpc-ish code. a handful of common instructions with random registers
+//and immediates - compresses about as well as the real thing
+static std::vector<uint8_t> make_text(size_t size, std::mt19937& rng) {
+	static const uint32_t opcodes[] = {
+		0x38000000, //addi
+		0x80000000, //lwz
+		0x90000000, //stw
+		0x7C000378, //or (mr)
+		0x48000001, //bl
+		0x41820000, //beq
+		0x2C000000, //cmpwi
+		0x60000000, //nop/ori
+	};
+	std::vector<uint8_t> text(size & ~3);
+	for (size_t i = 0; i < text.size(); i += 4) {
+		uint32_t op = opcodes[rng() % std::size(opcodes)];
+		switch (op >> 26) {
+			case 18: op |= (rng() % 0x10000) << 2; break;
+			case 31: op |= (rng() % 32) << 21 | (rng() % 32) << 16 | (rng() % 32) << 11; break;
+			case 24: if (rng() % 2) { op = 0x60000000; break; } [[fallthrough]];
+			default: op |= (rng() % 32) << 21 | (rng() % 32) << 16 | (rng() % 0x100) << 2; break;
+		}
+		//the odd function epilogue
+		if (rng() % 32 == 0) op = 0x4E800020; //blr
+		put_be32(text, i, op);
+	}
+	return text;
+}
+
+static std::vector<uint8_t> make_rodata(size_t size, std::mt19937& rng) {
+	static const char* words[] = {
+		"error", "failed to", "open", "file", "%s", "%d", "texture", "model",
+		"/vol/content/", ".bfres", "sound", "player", "save", "data", "ok",
+	};
+	std::vector<uint8_t> rodata;
+	rodata.reserve(size);
+	while (rodata.size() < size) {
+		if (rng() % 4 == 0) {
+			//a table of floats
+			for (int i = 0; i < 16; i++) {
+				float f = (float)(rng() % 1000) / 10.0f;
+				uint32_t bits;
+				memcpy(&bits, &f, sizeof(bits));
+				for (int b = 3; b >= 0; b--) rodata.push_back(bits >> (b * 8));
+			}
+		} else {
+			//a string
+			for (int i = rng() % 6 + 1; i > 0; i--) {
+				std::string word = words[rng() % std::size(words)];
+				rodata.insert(rodata.end(), word.begin(), word.end());
+				rodata.push_back(' ');
+			}
+			rodata.back() = '\0';
+		}
+	}
+	rodata.resize(size);
+	return rodata;
+}
+
+//mostly zeroes, with the odd pointer
+static std::vector<uint8_t> make_data(size_t size, std::mt19937& rng) {
+	std::vector<uint8_t> data(size & ~3);
+	for (size_t i = 0; i < data.size(); i += 4) {
+		switch (rng() % 8) {
+			case 0: put_be32(data, i, 0x10000000 + (rng() % 0x100000) * 4); break;
+			case 1: put_be32(data, i, rng() % 0x100); break;
+			default: break;
+		}
+	}
+	return data;
+}
+
+//Elf32_Sym entries pointing into .text, named from make_strtab
+static std::vector<uint8_t> make_symtab(size_t size, size_t names, std::mt19937& rng) {
+	std::vector<uint8_t> symtab(size / 16 * 16);
+	uint32_t addr = 0x02000000;
+	for (size_t i = 16; i < symtab.size(); i += 16) {
+		uint32_t fsize = (rng() % 0x100 + 1) * 4;
+		put_be32(symtab, i + 0, (uint32_t)((i / 16 * 12) % names)); //st_name
+		put_be32(symtab, i + 4, addr);                               //st_value
+		put_be32(symtab, i + 8, fsize);                              //st_size
+		symtab[i + 12] = 0x12;                                       //global func
+		symtab[i + 13] = 0;
+		symtab[i + 14] = 0;
+		symtab[i + 15] = 1;                                          //.text
+		addr += fsize;
+	}
+	return symtab;
+}
+
+static std::vector<uint8_t> make_strtab(size_t size, std::mt19937& rng) {
+	static const char* parts[] = {
+		"Update", "Draw", "Init", "Shutdown", "Get", "Set", "Player", "Enemy",
+		"Camera", "Sound", "Load", "File", "Texture", "Mesh", "Anim",
+	};
+	std::vector<uint8_t> strtab(1, '\0');
+	strtab.reserve(size);
+	while (strtab.size() < size) {
+		std::string name = "_ZN";
+		for (int i = rng() % 3 + 2; i > 0; i--) {
+			std::string part = parts[rng() % std::size(parts)];
+			name += std::to_string(part.size()) + part;
+		}
+		name += "Ev";
+		strtab.insert(strtab.end(), name.begin(), name.end());
+		strtab.push_back('\0');
+	}
+	strtab.resize(size);
+	strtab.back() = '\0';
+	return strtab;
+}
+
+//Elf32_Rela entries patching .text - mostly ADDR16_HA/LO pairs and REL24
+static std::vector<uint8_t> make_rela(size_t size, std::mt19937& rng) {
+	std::vector<uint8_t> rela(size / 12 * 12);
+	uint32_t offset = 0x02000000;
+	for (size_t i = 0; i < rela.size(); i += 12) {
+		static const uint8_t types[] = { 1, 4, 6, 10 };
+		offset += (rng() % 16 + 1) * 4;
+		put_be32(rela, i + 0, offset);
+		put_be32(rela, i + 4, (rng() % 0x1000) << 8 | types[rng() % std::size(types)]);
+		put_be32(rela, i + 8, rng() % 0x100 * 4);
+	}
+	return rela;
+}
+
+//makes a decompressed rpx of roughly total_size bytes. it's been relinked
+//and its crcs are filled in, just like after rpx::decompress.
+static rpx::rpx make_rpx(size_t total_size, uint32_t seed = 0x5EED) {
+	std::mt19937 rng(seed);
+
+	static const section_desc descs[] = {
+		{ "",           0,                                0,   0,          0.00, section_desc::NONE },
+		{ ".text",      rpx::SHT_PROGBITS,                0x6, 0x02000000, 0.55, section_desc::TEXT },
+		{ ".fexports",  (uint32_t)rpx::SHT_RPL_EXPORTS,   0x6, 0x10000000, 0.00, section_desc::NONE },
+		{ ".rodata",    rpx::SHT_PROGBITS,                0x2, 0x10001000, 0.18, section_desc::RODATA },
+		{ ".data",      rpx::SHT_PROGBITS,                0x3, 0x10800000, 0.10, section_desc::DATA },
+		{ ".bss",       rpx::SHT_NOBITS,                  0x3, 0x10900000, 0.00, section_desc::NONE },
+		{ ".rela.text", rpx::SHT_RELA,                    0x0, 0,          0.07, section_desc::RELA },
+		{ ".symtab",    rpx::SHT_SYMTAB,                  0x2, 0xC0000000, 0.05, section_desc::SYMTAB },
+		{ ".strtab",    rpx::SHT_STRTAB,                  0x2, 0xC0100000, 0.05, section_desc::STRTAB },
+		{ ".shstrtab",  rpx::SHT_STRTAB,                  0x2, 0xC0200000, 0.00, section_desc::SHSTRTAB },
+		{ "",           (uint32_t)rpx::SHT_RPL_CRCS,      0,   0,          0.00, section_desc::CRCS },
+		{ "",           (uint32_t)rpx::SHT_RPL_FILEINFO,  0,   0,          0.00, section_desc::FILEINFO },
+	};
+	const size_t count = std::size(descs);
+
+	rpx::rpx elf;
+	memset(&elf.ehdr, 0, sizeof(elf.ehdr));
+	memcpy(elf.ehdr.e_ident, "\x7f""ELF\x01\x02\x01\xCA\xFE", 9);
+	elf.ehdr.e_type = (uint16_t)0xFE01;
+	elf.ehdr.e_machine = (uint16_t)20;
+	elf.ehdr.e_version = 1u;
+	elf.ehdr.e_entry = 0x02000000u;
+	elf.ehdr.e_shoff = 0x40u;
+	elf.ehdr.e_ehsize = (uint16_t)sizeof(rpx::Elf32_Ehdr);
+	elf.ehdr.e_shentsize = (uint16_t)sizeof(rpx::Elf32_Shdr);
+	elf.ehdr.e_shnum = (uint16_t)count;
+	elf.ehdr.e_shstrndx = (uint16_t)9;
+
+	std::vector<uint8_t> shstrtab(1, '\0');
+	elf.sections.resize(count);
+	for (size_t i = 0; i < count; i++) {
+		const auto& desc = descs[i];
+		auto& section = elf.sections[i];
+		memset(&section.hdr, 0, sizeof(section.hdr));
+		section.hdr.sh_name = (uint32_t)(desc.name[0] ? shstrtab.size() : 0);
+		if (desc.name[0]) shstrtab.insert(shstrtab.end(), desc.name, desc.name + strlen(desc.name) + 1);
+		section.hdr.sh_type = desc.type;
+		section.hdr.sh_flags = desc.flags;
+		section.hdr.sh_addr = desc.addr;
+		section.hdr.sh_addralign = 4u;
+
+		size_t size = (size_t)(total_size * desc.share);
+		std::vector<uint8_t> data;
+		switch (desc.kind) {
+			case section_desc::TEXT: data = make_text(size, rng); break;
+			case section_desc::RODATA: data = make_rodata(size, rng); break;
+			case section_desc::DATA: data = make_data(size, rng); break;
+			case section_desc::SYMTAB: data = make_symtab(size, (size_t)(total_size * 0.05), rng); break;
+			case section_desc::STRTAB: data = make_strtab(size, rng); break;
+			case section_desc::RELA: data = make_rela(size, rng); break;
+			case section_desc::FILEINFO: data.resize(0x60); break;
+			//filled in once we know all the names/sections
+			case section_desc::SHSTRTAB: case section_desc::CRCS: break;
+			case section_desc::NONE:
+				if (desc.type == rpx::SHT_RPL_EXPORTS) data.resize(8);
+				if (desc.type == rpx::SHT_NOBITS) section.hdr.sh_size = 0x10000u;
+				break;
+		}
+		if (desc.type == rpx::SHT_SYMTAB) {
+			section.hdr.sh_link = 8u;
+			section.hdr.sh_entsize = 16u;
+		}
+		if (desc.type == rpx::SHT_RELA) {
+			section.hdr.sh_link = 7u;
+			section.hdr.sh_info = 1u;
+			section.hdr.sh_entsize = 12u;
+		}
+		if (!data.empty()) section.hdr.sh_offset = 1u; //anything non-zero, relink sorts it out
+		section.data = std::move(data);
+	}
+	elf.sections[9].data = std::move(shstrtab);
+	elf.sections[9].hdr.sh_offset = 1u;
+	elf.sections[10].data.resize(count * sizeof(uint32_t));
+	elf.sections[10].hdr.sh_offset = 1u;
+
+	elf.section_file_order = { 0, 5, 10, 11, 1, 2, 3, 4, 6, 7, 8, 9 };
+
+	//fills in crcs and relinks
+	rpx::decompress(elf);
+	return elf;
+}
+
+}
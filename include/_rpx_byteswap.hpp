@@ -0,0 +1,66 @@
+// Copyright (C) 2020 Ash Logan <ash@heyquark.com>
+// Licensed under the terms of the GNU GPL, version 3
+// http://www.gnu.org/licenses/gpl-3.0.txt
+
+#pragma once
+
+#include "_rpx_elf.hpp"
+#include <span>
+#include <cstdint>
+
+namespace rpx {
+
+//the elf structs again, in native byte order. for when there's a lot of them
+//to get through (i.e. a whole symbol table) and going through be2_val for
+//every field adds up.
+namespace native {
+
+typedef struct {
+	uint32_t sh_name;
+	uint32_t sh_type;
+	uint32_t sh_flags;
+	uint32_t sh_addr;
+	uint32_t sh_offset;
+	uint32_t sh_size;
+	uint32_t sh_link;
+	uint32_t sh_info;
+	uint32_t sh_addralign;
+	uint32_t sh_entsize;
+} Elf32_Shdr;
+
+typedef struct {
+	uint32_t st_name;
+	uint32_t st_value;
+	uint32_t st_size;
+	uint8_t  st_info;
+	uint8_t  st_other;
+	uint16_t st_shndx;
+} Elf32_Sym;
+
+typedef struct {
+	uint32_t r_offset;
+	uint32_t r_info;
+	int32_t  r_addend;
+} Elf32_Rela;
+
+};
+
+//bulk conversion between big endian arrays (as they are in the file) and
+//native ones, using SIMD where the cpu has it. converts as many elements as
+//there's room for in both in and out.
+void from_be(std::span<const be2_val<uint16_t>> in, std::span<uint16_t> out);
+void from_be(std::span<const be2_val<uint32_t>> in, std::span<uint32_t> out);
+void from_be(std::span<const Elf32_Shdr> in, std::span<native::Elf32_Shdr> out);
+void from_be(std::span<const Elf32_Sym> in, std::span<native::Elf32_Sym> out);
+void from_be(std::span<const Elf32_Rela> in, std::span<native::Elf32_Rela> out);
+
+void to_be(std::span<const uint16_t> in, std::span<be2_val<uint16_t>> out);
+void to_be(std::span<const uint32_t> in, std::span<be2_val<uint32_t>> out);
+void to_be(std::span<const native::Elf32_Shdr> in, std::span<Elf32_Shdr> out);
+void to_be(std::span<const native::Elf32_Sym> in, std::span<Elf32_Sym> out);
+void to_be(std::span<const native::Elf32_Rela> in, std::span<Elf32_Rela> out);
+
+//name of the byteswap implementation picked for this cpu, i.e. "avx2".
+const char* byteswap_engine();
+
+};
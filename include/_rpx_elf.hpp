@@ -9,6 +9,7 @@
 
 namespace rpx {
 
+const static int SHF_EXECINSTR    = 0x00000004;
 const static int SHF_RPL_ZLIB     = 0x08000000;
 
 const static int SHT_PROGBITS     = 0x00000001;
@@ -22,6 +23,36 @@ const static int SHT_RPL_IMPORTS  = 0x80000002;
 const static int SHT_RPL_CRCS     = 0x80000003;
 const static int SHT_RPL_FILEINFO = 0x80000004;
 
+const static int SHN_UNDEF        = 0x0000;
+const static int SHN_LORESERVE    = 0xFF00;
+
+//st_info is (binding << 4) | type
+const static int STB_LOCAL        = 0;
+const static int STB_GLOBAL       = 1;
+const static int STB_WEAK         = 2;
+
+const static int STT_NOTYPE       = 0;
+const static int STT_OBJECT       = 1;
+const static int STT_FUNC         = 2;
+const static int STT_SECTION      = 3;
+const static int STT_FILE         = 4;
+
+//the powerpc relocations rpx files use. r_info is (symbol << 8) | type.
+const static int R_PPC_NONE          = 0;
+const static int R_PPC_ADDR32        = 1;
+const static int R_PPC_ADDR24        = 2;
+const static int R_PPC_ADDR16        = 3;
+const static int R_PPC_ADDR16_LO     = 4;
+const static int R_PPC_ADDR16_HI     = 5;
+const static int R_PPC_ADDR16_HA     = 6;
+const static int R_PPC_ADDR14        = 7;
+const static int R_PPC_REL24         = 10;
+const static int R_PPC_REL14         = 11;
+const static int R_PPC_REL32         = 26;
+const static int R_PPC_GHS_REL16_HA  = 251;
+const static int R_PPC_GHS_REL16_HI  = 252;
+const static int R_PPC_GHS_REL16_LO  = 253;
+
 typedef struct {
 	uint8_t  e_ident[0x10];
 	be2_val<uint16_t> e_type;
@@ -52,4 +83,21 @@ typedef struct {
 	be2_val<uint32_t> sh_entsize;
 } Elf32_Shdr;
 
+//entries of SHT_SYMTAB sections
+typedef struct {
+	be2_val<uint32_t> st_name;
+	be2_val<uint32_t> st_value;
+	be2_val<uint32_t> st_size;
+	uint8_t           st_info;
+	uint8_t           st_other;
+	be2_val<uint16_t> st_shndx;
+} Elf32_Sym;
+
+//entries of SHT_RELA sections
+typedef struct {
+	be2_val<uint32_t> r_offset;
+	be2_val<uint32_t> r_info;
+	be2_val<int32_t>  r_addend;
+} Elf32_Rela;
+
 };
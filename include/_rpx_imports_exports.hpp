@@ -0,0 +1,82 @@
+// Copyright (C) 2020 Ash Logan <ash@heyquark.com>
+// Licensed under the terms of the GNU GPL, version 3
+// http://www.gnu.org/licenses/gpl-3.0.txt
+
+#pragma once
+
+#include "_rpx_name_table.hpp"
+#include <vector>
+#include <span>
+#include <string_view>
+#include <cstdint>
+
+namespace rpx {
+
+//a symbol from an SHT_RPL_EXPORTS section (.fexports or .dexports)
+struct rpl_export {
+	//points into the export section
+	std::string_view name;
+	uint32_t value;
+	//from .fexports rather than .dexports
+	bool function;
+	bool tls;
+};
+
+//an rpl another one imports from - one per SHT_RPL_IMPORTS section
+//(.fimport_coreinit, .dimport_coreinit and so on)
+struct rpl_library {
+	//points into the import section, i.e. "coreinit"
+	std::string_view name;
+	uint32_t section;
+	//from a .fimport section rather than a .dimport one
+	bool function;
+	//this library's imports are imports()[first_import] onwards
+	uint32_t first_import;
+	uint32_t import_count;
+};
+
+//a symbol pulled in from another rpl
+struct rpl_import {
+	//points into the symbol's string table
+	std::string_view name;
+	//where the loader puts the stub or pointer
+	uint32_t value;
+	//index into libraries()
+	uint32_t library;
+};
+
+//the imports and exports of an rpx, parsed once, for looking up by name. like
+//symbol_index, the names are views into the rpx, which has to outlive this.
+class import_export_index {
+public:
+	import_export_index() = default;
+	//builds the lookup tables. imports have to be grouped by library, in the
+	//same order as libraries. see index_imports_exports() to get these from an
+	//rpx.
+	import_export_index(std::vector<rpl_export> exports, std::vector<rpl_library> libraries, std::vector<rpl_import> imports);
+
+	//lookups by name, or nullptr. for duplicates the first one wins.
+	const rpl_export* find_export(std::string_view name) const;
+	const rpl_import* find_import(std::string_view name) const;
+	//an rpl can have both a .fimport and a .dimport section for a library -
+	//this gets the first
+	const rpl_library* find_library(std::string_view name) const;
+
+	std::span<const rpl_export> exports() const { return export_entries; }
+	std::span<const rpl_library> libraries() const { return library_entries; }
+	std::span<const rpl_import> imports() const { return import_entries; }
+	//the imports from one library
+	std::span<const rpl_import> imports(const rpl_library& library) const {
+		return imports().subspan(library.first_import, library.import_count);
+	}
+
+private:
+	std::vector<rpl_export> export_entries;
+	std::vector<rpl_library> library_entries;
+	std::vector<rpl_import> import_entries;
+	name_table export_names;
+	name_table library_names;
+	name_table import_names;
+};
+
+};
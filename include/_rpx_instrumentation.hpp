@@ -0,0 +1,53 @@
+// Copyright (C) 2020 Ash Logan <ash@heyquark.com>
+// Licensed under the terms of the GNU GPL, version 3
+// http://www.gnu.org/licenses/gpl-3.0.txt
+
+#pragma once
+
+//optional timing and byte counts for each stage. only there when the library
+//is built with -DWIIURPX_INSTRUMENTATION=ON - otherwise none of this exists
+//and the library doesn't spend a single instruction on it.
+#ifdef WIIURPX_INSTRUMENTATION
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+
+namespace rpx {
+
+enum class stage {
+	readrpx,
+	maprpx,
+	decompress,
+	compress,
+	relink,
+	writerpx,
+};
+
+//one of these is reported for each section a stage works on, then one more
+//with section == whole_stage covering the entire call.
+struct stage_event {
+	static constexpr size_t whole_stage = (size_t)-1;
+
+	enum stage stage;
+	size_t section;
+	//wall time, including crc_nanoseconds
+	uint64_t nanoseconds;
+	//time spent working out crcs
+	uint64_t crc_nanoseconds;
+	uint64_t bytes_in;
+	uint64_t bytes_out;
+
+	//bytes_out / bytes_in - i.e. how well a section compressed
+	double ratio() const { return bytes_in ? (double)bytes_out / bytes_in : 0.0; }
+};
+
+typedef std::function<void(const stage_event& event)> instrumentation_fn;
+
+//sets the function that gets every stage_event, or clears it with nullptr.
+//with threads, this gets called from several threads at once.
+void set_instrumentation(instrumentation_fn fn);
+
+};
+
+#endif
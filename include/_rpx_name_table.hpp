@@ -0,0 +1,43 @@
+// Copyright (C) 2020 Ash Logan <ash@heyquark.com>
+// Licensed under the terms of the GNU GPL, version 3
+// http://www.gnu.org/licenses/gpl-3.0.txt
+
+#pragma once
+
+#include <vector>
+#include <string_view>
+#include <cstdint>
+#include <cstddef>
+
+namespace rpx {
+
+//a hash table from names to indices into some other array, for the lookup
+//indexes. open addressing with linear probing, and the names are views - so
+//whatever they point into has to outlive the table.
+class name_table {
+public:
+	static constexpr uint32_t npos = UINT32_MAX;
+
+	//makes room for count names without growing
+	void reserve(size_t count);
+	//adds name -> index. if the name's already there, the first one stays.
+	void insert(std::string_view name, uint32_t index);
+	//the index for name, or npos
+	uint32_t find(std::string_view name) const;
+
+	size_t size() const { return count; }
+
+private:
+	struct slot {
+		std::string_view name;
+		uint32_t hash;
+		uint32_t index = npos;
+	};
+
+	void rehash(size_t slot_count);
+
+	std::vector<slot> slots;
+	size_t count = 0;
+};
+
+};
@@ -0,0 +1,64 @@
+// Copyright (C) 2020 Ash Logan <ash@heyquark.com>
+// Licensed under the terms of the GNU GPL, version 3
+// http://www.gnu.org/licenses/gpl-3.0.txt
+
+#pragma once
+
+#include <vector>
+#include <span>
+#include <string>
+#include <optional>
+#include <filesystem>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+namespace rpx {
+
+struct deflate_settings;
+
+//a directory of deflated sections, kept between runs. entries are named by a
+//sha256 of the uncompressed bytes, the deflate_settings and the compression
+//backend, so the same section compressed the same way is only ever deflated
+//once. once the directory goes over max_bytes, the least recently used
+//entries are deleted.
+//several threads and processes can share one directory - entries are written
+//to a temporary file and renamed into place, and a broken or missing entry is
+//just a miss.
+//the directory can hold other things too - trimming only ever deletes files
+//named and laid out like entries (or their temporary files).
+class section_cache {
+public:
+	section_cache(std::filesystem::path dir, uint64_t max_bytes = 512 * 1024 * 1024);
+
+	//the name of the entry for these bytes, deflated with these settings
+	std::string key(std::span<const uint8_t> uncompressed, const deflate_settings& settings) const;
+
+	//gets the zlib stream stored under key, if there is one
+	std::optional<std::vector<uint8_t>> get(const std::string& key) const;
+	//stores a zlib stream under key
+	void put(const std::string& key, std::span<const uint8_t> compressed) const;
+
+	//deletes the least recently used entries until the cache is under
+	//max_bytes again. this goes over the whole directory, so it's slow on a
+	//big cache.
+	void trim() const;
+	//trims if it hasn't been trimmed yet, or once a sixteenth of max_bytes
+	//has been added since the last trim. compress() calls this after adding
+	//anything.
+	void trim_if_due() const;
+
+	//sections smaller than this aren't worth a file of their own
+	size_t min_section_size = 4096;
+
+private:
+	std::filesystem::path entry_path(const std::string& key) const;
+
+	std::filesystem::path dir;
+	uint64_t max_bytes;
+	//bytes put() since the last trim. starts out due, so the first run
+	//against a directory catches up on whatever earlier ones left.
+	mutable std::atomic<uint64_t> untrimmed_bytes;
+};
+
+};
@@ -0,0 +1,187 @@
+// Copyright (C) 2020 Ash Logan <ash@heyquark.com>
+// Licensed under the terms of the GNU GPL, version 3
+// http://www.gnu.org/licenses/gpl-3.0.txt
+
+#pragma once
+
+#include <vector>
+#include <span>
+#include <memory>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <memory_resource>
+
+namespace rpx {
+
+//one big pool for all the sections of an rpx, so reading, decompressing and
+//compressing a file takes a handful of large allocations rather than a few
+//for every section. nothing is freed until the arena itself goes away (it's
+//kept alive by every section using it), so it suits a load-work-save cycle
+//with a fresh arena per file. safe to use from several threads at once.
+class section_arena {
+public:
+	section_arena(size_t initial_size = 1024 * 1024) : pool(initial_size) {}
+	section_arena(const section_arena&) = delete;
+	section_arena& operator=(const section_arena&) = delete;
+
+	std::span<uint8_t> allocate(size_t size) {
+		std::lock_guard lock(mutex);
+		total += size;
+		return std::span((uint8_t*)pool.allocate(size ? size : 1, 16), size);
+	}
+	//how much has been handed out so far
+	size_t allocated() const {
+		std::lock_guard lock(mutex);
+		return total;
+	}
+
+private:
+	mutable std::mutex mutex;
+	std::pmr::monotonic_buffer_resource pool;
+	size_t total = 0;
+};
+
+//the bytes of a section. usually these are owned, but they can also be
+//borrowed from someone else (i.e. a file mapping, see maprpx) - in that case
+//the bytes are copied out the first time they're accessed through a non-const
+//member, so the original is never modified. bytes from a section_arena are
+//borrowed too, but can be modified in place - they're only copied out when
+//the size changes.
+//it also remembers whether it's been modified, for the same reason - anything
+//non-const counts, whether or not the bytes actually change.
+//tip: use view() or std::as_const to read borrowed data without copying it.
+class section_data {
+public:
+	using value_type = uint8_t;
+	using iterator = uint8_t*;
+	using const_iterator = const uint8_t*;
+
+	section_data() = default;
+	section_data(std::vector<uint8_t>&& bytes) : owned(std::move(bytes)) {}
+	section_data(const std::vector<uint8_t>& bytes) : owned(bytes) {}
+
+	section_data& operator=(std::vector<uint8_t>&& bytes) {
+		owned = std::move(bytes);
+		release();
+		is_modified = true;
+		return *this;
+	}
+	section_data& operator=(const std::vector<uint8_t>& bytes) {
+		owned = bytes;
+		release();
+		is_modified = true;
+		return *this;
+	}
+
+	//borrows bytes without copying them. keepalive is held on to until the
+	//bytes are copied out or replaced.
+	static section_data borrow(std::span<const uint8_t> bytes, std::shared_ptr<const void> keepalive) {
+		section_data data;
+		data.borrowed = bytes;
+		data.keepalive = std::move(keepalive);
+		data.is_borrowed = true;
+		return data;
+	}
+	//size bytes of zeroes from arena, or a plain vector without one
+	static section_data allocate(size_t size, const std::shared_ptr<section_arena>& arena) {
+		if (!arena) return std::vector<uint8_t>(size);
+
+		auto bytes = arena->allocate(size);
+		std::fill(bytes.begin(), bytes.end(), 0);
+		auto data = borrow(bytes, arena);
+		data.is_writable = true;
+		return data;
+	}
+
+	//arena bytes can be written in place, so copies need their own
+	section_data(const section_data& other) { *this = other; }
+	section_data& operator=(const section_data& other) {
+		if (this == &other) return *this;
+		if (other.is_writable) {
+			owned.assign(other.borrowed.begin(), other.borrowed.end());
+			release();
+		} else {
+			owned = other.owned;
+			borrowed = other.borrowed;
+			keepalive = other.keepalive;
+			is_borrowed = other.is_borrowed;
+			//whatever we had from an arena is gone, and this isn't ours to write
+			is_writable = false;
+		}
+		is_modified = other.is_modified;
+		return *this;
+	}
+	section_data(section_data&&) = default;
+	section_data& operator=(section_data&&) = default;
+
+	//whether the bytes are still borrowed - from a mapping, they haven't been
+	//modified yet. from an arena, they just haven't changed size.
+	bool borrowed_data() const { return is_borrowed; }
+
+	//whether the bytes have been touched since the last mark_unmodified().
+	//readrpx, maprpx and decompress leave every section unmodified.
+	bool modified() const { return is_modified; }
+	void mark_unmodified() { is_modified = false; }
+
+	std::span<const uint8_t> view() const {
+		if (is_borrowed) return borrowed;
+		return owned;
+	}
+
+	const uint8_t* data() const { return view().data(); }
+	uint8_t* data() {
+		if (!is_writable) own();
+		is_modified = true;
+		return is_borrowed ? (uint8_t*)borrowed.data() : owned.data();
+	}
+	size_t size() const { return view().size(); }
+	bool empty() const { return size() == 0; }
+
+	const_iterator begin() const { return data(); }
+	const_iterator end() const { return data() + size(); }
+	const_iterator cbegin() const { return begin(); }
+	const_iterator cend() const { return end(); }
+	iterator begin() { return data(); }
+	iterator end() { return data() + size(); }
+
+	const uint8_t& operator[](size_t i) const { return data()[i]; }
+	uint8_t& operator[](size_t i) { return data()[i]; }
+
+	void resize(size_t size) {
+		is_modified = true;
+		if (is_writable && size == borrowed.size()) return;
+		own();
+		owned.resize(size);
+	}
+	void clear() { owned.clear(); release(); is_modified = true; }
+	void shrink_to_fit() { owned.shrink_to_fit(); }
+
+	//access to the underlying vector, for anything not covered above.
+	//takes a copy of borrowed bytes first.
+	std::vector<uint8_t>& vector() { own(); is_modified = true; return owned; }
+
+private:
+	void own() {
+		if (!is_borrowed) return;
+		owned.assign(borrowed.begin(), borrowed.end());
+		release();
+	}
+	void release() {
+		borrowed = {};
+		keepalive.reset();
+		is_borrowed = false;
+		is_writable = false;
+	}
+
+	std::vector<uint8_t> owned;
+	std::span<const uint8_t> borrowed;
+	std::shared_ptr<const void> keepalive;
+	bool is_borrowed = false;
+	//borrowed from a section_arena, so ours to change
+	bool is_writable = false;
+	bool is_modified = false;
+};
+
+};
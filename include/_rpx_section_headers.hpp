@@ -0,0 +1,51 @@
+// Copyright (C) 2020 Ash Logan <ash@heyquark.com>
+// Licensed under the terms of the GNU GPL, version 3
+// http://www.gnu.org/licenses/gpl-3.0.txt
+
+#pragma once
+
+#include "_rpx_elf.hpp"
+#include <vector>
+#include <span>
+#include <cstdint>
+#include <cstddef>
+
+namespace rpx {
+
+//the section header table as a structure of arrays - one native endian array
+//per field. for going over every header at once (sorting by offset, finding
+//sections by type or size), so a pass only touches the fields it needs and
+//nothing gets swapped along the way. it's a copy - changing the headers
+//afterwards doesn't change this.
+struct section_headers {
+	static constexpr size_t npos = SIZE_MAX;
+
+	std::vector<uint32_t> sh_name;
+	std::vector<uint32_t> sh_type;
+	std::vector<uint32_t> sh_flags;
+	std::vector<uint32_t> sh_addr;
+	std::vector<uint32_t> sh_offset;
+	std::vector<uint32_t> sh_size;
+	std::vector<uint32_t> sh_link;
+	std::vector<uint32_t> sh_info;
+	std::vector<uint32_t> sh_addralign;
+	std::vector<uint32_t> sh_entsize;
+
+	section_headers() = default;
+	//converts a whole table of big endian headers. see header_table() to get
+	//these from an rpx.
+	explicit section_headers(std::span<const Elf32_Shdr> headers);
+
+	size_t size() const { return sh_offset.size(); }
+	void resize(size_t count);
+	//fills in one section from its big endian header
+	void set(size_t index, const Elf32_Shdr& hdr);
+
+	//section indices in the order their data is in the file. sections with no
+	//data (sh_offset 0) come first, and ties go by index.
+	std::vector<size_t> file_order() const;
+	//the first section of this type at or after start, or npos
+	size_t find_type(uint32_t type, size_t start = 0) const;
+};
+
+};
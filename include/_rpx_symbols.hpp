@@ -0,0 +1,59 @@
+// Copyright (C) 2020 Ash Logan <ash@heyquark.com>
+// Licensed under the terms of the GNU GPL, version 3
+// http://www.gnu.org/licenses/gpl-3.0.txt
+
+#pragma once
+
+#include "_rpx_name_table.hpp"
+#include <vector>
+#include <span>
+#include <string_view>
+#include <cstdint>
+
+namespace rpx {
+
+struct symbol {
+	//points into the rpx's string table
+	std::string_view name;
+	uint32_t value;
+	uint32_t size;
+	//STT_*
+	uint8_t type;
+	//STB_*
+	uint8_t binding;
+	uint16_t shndx;
+};
+
+//every symbol in an rpx, parsed once, for looking up by name or address. the
+//names are views into the rpx's string tables, so the rpx has to outlive the
+//index - and its string tables can't be modified in the meantime.
+class symbol_index {
+public:
+	symbol_index() = default;
+	//builds the lookup tables. see index_symbols() to get these from an rpx.
+	explicit symbol_index(std::vector<symbol> symbols);
+
+	//the symbol called name, or nullptr. if there's more than one, globals win
+	//over locals, then the first one in the file.
+	const symbol* find(std::string_view name) const;
+	//the symbol addr falls inside (or, for symbols without a size, the closest
+	//one at or before it), or nullptr. if it's inside more than one, the one
+	//that starts closest to addr wins. only defined functions and objects count.
+	const symbol* find_address(uint32_t addr) const;
+
+	//every named symbol, sorted by address
+	std::span<const symbol> symbols() const { return entries; }
+
+private:
+	std::vector<symbol> entries;
+	//the ones with addresses, sorted. split out so a binary search only
+	//touches a packed array of uint32s.
+	std::vector<uint32_t> addresses;
+	std::vector<uint32_t> address_entries;
+	//the furthest any of addresses[0..i] reaches, so find_address knows when
+	//to stop looking further back for one that overlaps
+	std::vector<uint64_t> max_ends;
+	name_table names;
+};
+
+};
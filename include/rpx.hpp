@@ -5,10 +5,25 @@
 #pragma once
 
 #include "_rpx_elf.hpp"
+#include "_rpx_byteswap.hpp"
+#include "_rpx_section_data.hpp"
+#include "_rpx_instrumentation.hpp"
+#include "_rpx_section_cache.hpp"
+#include "_rpx_section_headers.hpp"
+#include "_rpx_symbols.hpp"
+#include "_rpx_imports_exports.hpp"
 #include <vector>
 #include <cstdint>
 #include <optional>
 #include <iostream>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <future>
+#include <span>
+#include <map>
+#include <string>
+#include <string_view>
 
 namespace rpx {
 
@@ -16,26 +31,276 @@ typedef struct {
 	Elf32_Ehdr ehdr;
 	typedef struct {
 		Elf32_Shdr hdr;
-		std::vector<uint8_t> data;
+		section_data data;
 		uint32_t crc32;
+		//the section's compressed bytes as they were before decompress(). if
+		//data hasn't been modified since, compress() puts these straight back
+		//instead of deflating it all over again.
+		section_data original;
 	} Section;
 	std::vector<Section> sections;
 	std::vector<size_t> section_file_order;
+	//if set, section data made by readrpx, decompress and compress comes
+	//from here instead of a vector each
+	std::shared_ptr<section_arena> arena;
 } rpx;
 
-//reads a file into an rpx struct.
-std::optional<rpx> readrpx(std::istream& is);
+//what probe() finds out about a file, without reading any section data
+struct rpx_probe {
+	Elf32_Ehdr ehdr;
+	typedef struct {
+		native::Elf32_Shdr hdr;
+		//the size once decompressed - read from the start of the section if
+		//it's SHF_RPL_ZLIB, otherwise the same as sh_size
+		uint32_t uncompressed_size;
+	} Section;
+	std::vector<Section> sections;
+	uint64_t file_size;
+
+	//whether any section is SHF_RPL_ZLIB
+	bool compressed() const {
+		for (const auto& section : sections) {
+			if (section.hdr.sh_flags & SHF_RPL_ZLIB) return true;
+		}
+		return false;
+	}
+};
+
+//runs job(0) through job(count - 1), possibly in parallel, and returns once
+//they've all finished. lets you run the library's work on your own thread pool.
+typedef std::function<void(size_t count, const std::function<void(size_t)>& job)> parallel_for_fn;
+
+struct decompress_options {
+	//threads to spread sections across. 1 is serial, 0 uses every core.
+	unsigned int threads = 1;
+	//if set, sections are handed to this instead of the built-in threads.
+	parallel_for_fn parallel_for;
+	//hang on to each section's compressed bytes (in Section::original), so
+	//compress() with reuse_unmodified can skip sections that haven't changed.
+	//costs the memory of the compressed file.
+	bool keep_original = false;
+};
+
+struct verify_options {
+	//threads to spread sections across. 1 is serial, 0 uses every core.
+	unsigned int threads = 1;
+	//if set, sections are handed to this instead of the built-in threads.
+	parallel_for_fn parallel_for;
+};
+
+//a section that doesn't match the SHT_RPL_CRCS table
+struct crc_mismatch {
+	size_t section;
+	//what the table says
+	uint32_t expected;
+	//what the section's data comes to, or nothing if it wouldn't inflate
+	std::optional<uint32_t> actual;
+};
+
+//how hard to squash a section. these are the arguments to zlib's
+//deflateInit2 - libdeflate only looks at level, but takes 0-12.
+struct deflate_settings {
+	int level = 6;
+	//Z_DEFAULT_STRATEGY, Z_FILTERED, Z_HUFFMAN_ONLY, Z_RLE or Z_FIXED
+	int strategy = 0;
+	int mem_level = 8;
+	//log2 of the window size, 9-15
+	int window_bits = 15;
+};
+
+struct relocate_options {
+	//threads to spread target sections across. 1 is serial, 0 uses every core.
+	unsigned int threads = 1;
+	//if set, sections are handed to this instead of the built-in threads.
+	parallel_for_fn parallel_for;
+	//the address to load each section at, by section index. sections past the
+	//end of this stay at their sh_addr.
+	std::vector<uint32_t> section_addresses;
+};
+
+struct diff_options {
+	//threads to spread sections across. 1 is serial, 0 uses every core.
+	unsigned int threads = 1;
+	//if set, sections are handed to this instead of the built-in threads.
+	parallel_for_fn parallel_for;
+	//changed sections are matched against the old section in blocks this big
+	//- smaller finds more of the old data, but makes for more (and smaller)
+	//pieces in the patch.
+	size_t block_size = 64;
+};
+
+struct patch_options {
+	//threads to spread sections across. 1 is serial, 0 uses every core.
+	unsigned int threads = 1;
+	//if set, sections are handed to this instead of the built-in threads.
+	parallel_for_fn parallel_for;
+};
+
+struct compress_options {
+	//threads to spread sections across. 1 is serial, 0 uses every core.
+	//output is identical no matter how many threads are used.
+	unsigned int threads = 1;
+	//if set, sections are handed to this instead of the built-in threads.
+	parallel_for_fn parallel_for;
+
+	//settings for every section...
+	deflate_settings settings;
+	//...except these ones, looked up by section name (i.e. ".text").
+	std::map<std::string, deflate_settings, std::less<>> section_settings;
+
+	//sections bigger than this are split into block_size pieces that get
+	//deflated in parallel (each using the end of the one before as its
+	//dictionary, like pigz) and joined back into one zlib stream. 0 turns
+	//this off. the output is still a normal zlib stream, but it won't match
+	//the original tool byte for byte - and it compresses a touch worse. zlib
+	//and zlib-ng only, libdeflate always does whole sections.
+	size_t block_threshold = 0;
+	size_t block_size = 128 * 1024;
+
+	//put back the original compressed bytes of any section that hasn't been
+	//modified since decompress(), rather than deflating it again. those bytes
+	//were made with whatever settings the file was built with, not the ones
+	//above, so only turn this on if that doesn't matter.
+	bool reuse_unmodified = false;
+
+	//if set, deflated sections are looked up in (and added to) this cache
+	//before deflating them. see section_cache.
+	const section_cache* cache = nullptr;
+
+	//what the original wiiurpxtool does, for byte-for-byte identical output.
+	//only holds with the zlib backend. every section is deflated again, since
+	//reusing the original bytes would make the output depend on how the input
+	//was built.
+	static compress_options match_original_tool() {
+		compress_options options;
+		options.block_threshold = 0;
+		options.reuse_unmodified = false;
+		return options;
+	}
+};
+
+//reads a file into an rpx struct. with an arena, every section is read into
+//it (and it's kept as rpx::arena for later stages).
+std::optional<rpx> readrpx(std::istream& is, std::shared_ptr<section_arena> arena = nullptr);
+//maps a file into memory and reads it into an rpx struct without copying any
+//section data. sections borrow from the mapping until they're modified.
+std::optional<rpx> maprpx(const std::filesystem::path& path);
+//reads just the headers of a file, and the stored uncompressed size of each
+//zlib section - a handful of small reads no matter how big the file is. fails
+//if it's not an rpx or anything points outside the file. section names aren't
+//read, since .shstrtab is usually compressed.
+std::optional<rpx_probe> probe(const std::filesystem::path& path);
 //writes an rpx struct back to a file.
 void writerpx(const rpx& rpx, std::ostream& os);
+//writes an rpx struct into a buffer, which must be at least writerpxsize()
+//bytes. any gaps are zeroed. returns false if the buffer is too small.
+bool writerpx(const rpx& rpx, std::span<uint8_t> out);
+//compresses an rpx and writes it out, with the same result as compress()
+//followed by writerpx() - block splitting and the cache included. the rpx
+//isn't modified, the stream is only ever written forwards (so it can be a
+//pipe) and compressed sections are never held in memory, bar ones that came
+//out of the cache. the catch is that each section gets deflated twice - once
+//to find its size for the section headers, then again on the way out.
+//with reuse_unmodified, unmodified sections are written as they were, like
+//compress() does.
+void writerpx_compressed(const rpx& rpx, std::ostream& os, const compress_options& options = {});
 //gets the size of an rpx that's going to be written
 size_t writerpxsize(const rpx& rpx);
 
+//readrpx() and decompress() at once - each section is inflated as soon as
+//it's been read in, while the next one is still being read. the stream has to
+//stay around until the future is ready.
+std::future<std::optional<rpx>> readrpx_async(std::istream& is, const decompress_options& options = {},
+	std::shared_ptr<section_arena> arena = nullptr);
+//compress() and writerpx() at once - sections are written out in file order
+//as soon as they're compressed, while later ones are still being worked on.
+//the headers and crc table go in last, so the stream has to be seekable. the
+//rpx ends up compressed, like with compress(), and it and the stream have to
+//stay around (and the rpx untouched) until the future is ready.
+std::future<void> writerpx_async(rpx& rpx, std::ostream& os, const compress_options& options = {});
+
 //re-links the rpx, adjusting file offsets as needed.
 //does not touch virtual addresses.
 void relink(rpx& rpx);
 //decompresses any zlib sections (SHF_RPL_ZLIB) in the rpx and relinks.
-void decompress(rpx& rpx);
+//returns false if any section failed to decompress - what's left of it is
+//still there, but it's probably not worth writing out.
+bool decompress(rpx& rpx, const decompress_options& options = {});
 //compresses any eligible sections with zlib (SHF_RPL_ZLIB) and relinks.
-void compress(rpx& rpx);
+//with compress_options::reuse_unmodified, sections that haven't been modified
+//since decompress() get their original compressed bytes back instead.
+//returns false if any section failed to compress (i.e. bad settings) - those
+//are left uncompressed.
+bool compress(rpx& rpx, const compress_options& options = {});
+
+//applies the SHT_RELA sections to the sections they target, as if every
+//section was loaded at options.section_addresses. sections are inflated as
+//needed (see section_contents) and the headers, symbols and relocations
+//themselves aren't changed, so it's fine to do this again with different
+//addresses. relocations that can't be applied (unknown types, out of range
+//branches or R_PPC_ADDR16 values) are skipped with a warning, and make this
+//return false.
+bool relocate(rpx& rpx, const relocate_options& options = {});
+
+//checks every section against the SHT_RPL_CRCS table, returning the ones that
+//don't match - so an empty list means it's all fine. compressed sections are
+//inflated a piece at a time and crc'd as they go, without keeping the result
+//or modifying the rpx. returns nothing if there's no crc table to check.
+std::optional<std::vector<crc_mismatch>> verify_crcs(const rpx& rpx, const verify_options& options = {});
+
+//works out a patch that turns from into to, for patch(). sections are lined up
+//by name (or by index, if there's no .shstrtab), and only what's changed goes
+//in - unchanged sections are just a reference to the old one, and changed
+//ones are stored as the parts of the old section that are still in there plus
+//whatever's new. either rpx can be compressed or not. a compressed section in
+//to can only be diffed if deflating it again with compress's settings gives
+//back the same bytes (so patch() can do the same) - otherwise it's stored
+//whole. the patch itself is deflated too.
+std::vector<uint8_t> diff(const rpx& from, const rpx& to, const diff_options& options = {},
+	const compress_options& compress = {});
+//rebuilds the rpx a patch was made from, given the same from that diff() was.
+//writerpx() on the result gives back exactly the file to was - headers and
+//all. returns nothing if the patch is broken, or any section doesn't come out
+//the way it should (the wrong from, or a backend that deflates differently).
+std::optional<rpx> patch(const rpx& from, std::span<const uint8_t> patch, const patch_options& options = {});
+
+//gets the decompressed contents of one section, inflating it first if it's
+//still compressed. the result is kept, so only the first call costs anything.
+//lets you skip decompress() when you only need a few sections. this doesn't
+//relink - call relink() (or decompress()) before writing the rpx out.
+const section_data& section_contents(rpx& rpx, size_t section);
+//gets the size a section will be once decompressed, without inflating it.
+uint32_t uncompressed_size(const rpx::Section& section);
+
+//the section headers, native endian and one array per field - see
+//section_headers. a snapshot, so get a new one after changing any headers.
+section_headers header_table(const rpx& rpx);
+
+//gets the name of a section from the section header string table, or an
+//empty string if there isn't one. needs .shstrtab to be decompressed.
+std::string_view section_name(const rpx& rpx, size_t section);
+
+//parses every SHT_SYMTAB section into a symbol_index. only the symbol and
+//string tables get inflated (see section_contents), so there's no need to
+//decompress() first.
+symbol_index index_symbols(rpx& rpx);
+//parses the SHT_RPL_EXPORTS and SHT_RPL_IMPORTS sections into an
+//import_export_index. like index_symbols, this only inflates the sections it
+//reads - the import/export sections, and the symbol tables if there are any
+//imports.
+import_export_index index_imports_exports(rpx& rpx);
+
+//name of the compression library the library was built with, i.e. "zlib".
+//set with WIIURPX_BACKEND in CMake.
+const char* compression_backend();
+
+//the crc32 used for the SHT_RPL_CRCS table (same as zlib's crc32). pass a
+//previous result as crc to continue it over more data, or 0 to start fresh.
+uint32_t crc32(uint32_t crc, std::span<const uint8_t> data);
+//the crc32 of two buffers one after the other, given the crc32 of each and the
+//length of the second. lets pieces be crc'd separately (or in parallel).
+uint32_t crc32_combine(uint32_t crc1, uint32_t crc2, size_t len2);
+//name of the crc32 implementation picked for this cpu, i.e. "pclmul".
+const char* crc32_engine();
 
 };
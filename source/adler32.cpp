@@ -0,0 +1,44 @@
+// Copyright (C) 2020 Ash Logan <ash@heyquark.com>
+// Licensed under the terms of the GNU GPL, version 3
+// http://www.gnu.org/licenses/gpl-3.0.txt
+
+#include "adler32.hpp"
+
+#include <algorithm>
+
+static const uint32_t BASE = 65521;
+//most bytes we can add up before b could overflow 32 bits
+static const size_t NMAX = 5552;
+
+uint32_t adler32(uint32_t adler, std::span<const uint8_t> data) {
+	uint32_t a = adler & 0xFFFF;
+	uint32_t b = adler >> 16;
+	const uint8_t* p = data.data();
+	size_t len = data.size();
+
+	while (len) {
+		size_t n = std::min(len, NMAX);
+		len -= n;
+		while (n--) {
+			a += *p++;
+			b += a;
+		}
+		a %= BASE;
+		b %= BASE;
+	}
+	return b << 16 | a;
+}
+
+//same maths as zlib's adler32_combine
+uint32_t adler32_combine(uint32_t adler1, uint32_t adler2, size_t len2) {
+	uint32_t rem = (uint32_t)(len2 % BASE);
+	uint32_t sum1 = adler1 & 0xFFFF;
+	uint32_t sum2 = (uint32_t)(((uint64_t)rem * sum1) % BASE);
+	sum1 += (adler2 & 0xFFFF) + BASE - 1;
+	sum2 += (adler1 >> 16) + (adler2 >> 16) + BASE - rem;
+	if (sum1 >= BASE) sum1 -= BASE;
+	if (sum1 >= BASE) sum1 -= BASE;
+	if (sum2 >= ((uint32_t)BASE << 1)) sum2 -= ((uint32_t)BASE << 1);
+	if (sum2 >= BASE) sum2 -= BASE;
+	return sum2 << 16 | sum1;
+}
@@ -0,0 +1,15 @@
+// Copyright (C) 2020 Ash Logan <ash@heyquark.com>
+// Licensed under the terms of the GNU GPL, version 3
+// http://www.gnu.org/licenses/gpl-3.0.txt
+
+#pragma once
+
+#include <span>
+#include <cstdint>
+#include <cstddef>
+
+//the checksum at the end of a zlib stream. start with 1.
+uint32_t adler32(uint32_t adler, std::span<const uint8_t> data);
+//the adler32 of two buffers one after the other, given the adler32 of each
+//and the length of the second
+uint32_t adler32_combine(uint32_t adler1, uint32_t adler2, size_t len2);
@@ -0,0 +1,150 @@
+// Copyright (C) 2020 Ash Logan <ash@heyquark.com>
+// Licensed under the terms of the GNU GPL, version 3
+// http://www.gnu.org/licenses/gpl-3.0.txt
+
+#include "rpx.hpp"
+
+#include <cstdio>
+#include <cstdint>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "util.hpp"
+#include "internal.hpp"
+#include "parallel.hpp"
+#include "instrumentation.hpp"
+
+using namespace rpx;
+using crc = be2_val<uint32_t>;
+
+namespace {
+
+//lets one side of a pipeline wait for the other to finish a given section
+class section_progress {
+public:
+	section_progress(size_t count) : ready(count) {}
+
+	void mark(size_t section) {
+		{
+			std::lock_guard lock(mutex);
+			ready[section] = true;
+		}
+		changed.notify_all();
+	}
+	void wait(size_t section) {
+		std::unique_lock lock(mutex);
+		changed.wait(lock, [&] { return ready[section]; });
+	}
+
+private:
+	std::mutex mutex;
+	std::condition_variable changed;
+	std::vector<bool> ready;
+};
+
+}
+
+std::future<std::optional<rpx::rpx>> rpx::readrpx_async(std::istream& is, const decompress_options& options,
+	std::shared_ptr<section_arena> arena) {
+	return std::async(std::launch::async, [&is, options, arena = std::move(arena)]() -> std::optional<rpx> {
+		RPX_TIMER(timer, readrpx, stage_event::whole_stage);
+		rpx elf;
+		elf.arena = arena;
+		if (!rpx_read_headers(elf, is)) return std::nullopt;
+
+		//the reading all happens on its own thread, in file order...
+		section_progress read(elf.sections.size());
+		std::thread reader([&] {
+			for (auto index : elf.section_file_order) {
+				rpx_read_section(elf, index, is);
+				read.mark(index);
+			}
+		});
+
+		//...while this one (and the pool) inflate each section once it's in.
+		//jobs get handed out in order, so this keeps right behind the reader.
+		const auto& order = elf.section_file_order;
+		run_parallel(order.size(), [&](size_t i) {
+			read.wait(order[i]);
+			rpx_decompress_section(elf, order[i], options.keep_original);
+		}, options.threads, options.parallel_for);
+		reader.join();
+
+		relink(elf);
+		RPX_TIMER_BYTES_OUT(timer, rpx_data_bytes(elf));
+		return elf;
+	});
+}
+
+std::future<void> rpx::writerpx_async(rpx& elf, std::ostream& os, const compress_options& options) {
+	return std::async(std::launch::async, [&elf, &os, options] {
+		RPX_TIMER(timer, writerpx, stage_event::whole_stage);
+		RPX_TIMER_BYTES_IN(timer, rpx_data_bytes(elf));
+
+		//the compressing all happens on other threads...
+		section_progress compressed(elf.sections.size());
+		std::thread compressor([&] {
+			rpx_compress_sections(elf, options, [&](size_t section) {
+				compressed.mark(section);
+			});
+		});
+
+		//...while this one writes each section once it and everything before
+		//it in the file are done. this is the same layout relink() is about to
+		//come up with.
+		uint32_t file_offset = elf.ehdr.e_shoff + elf.ehdr.e_shnum * elf.ehdr.e_shentsize;
+		bool first_section = true;
+		std::vector<uint32_t> offsets(elf.sections.size());
+		for (auto section_index : elf.section_file_order) {
+			compressed.wait(section_index);
+			const auto& section = elf.sections[section_index];
+			if (!section.hdr.sh_offset) continue;
+
+			if (!first_section) {
+				file_offset = alignup(file_offset, 0x40);
+			} else first_section = false;
+			offsets[section_index] = file_offset;
+
+			//the crc table needs every section, so it goes in at the end
+			if (section.hdr.sh_type == SHT_RPL_CRCS) {
+				file_offset += elf.sections.size() * sizeof(crc);
+				continue;
+			}
+			os.seekp(file_offset);
+			os.write((const char*)section.data.view().data(), section.data.size());
+			file_offset += section.data.size();
+		}
+		compressor.join();
+		relink(elf);
+
+		//shouldn't happen, but if the layout came out different just write the
+		//whole lot again
+		for (auto section_index : elf.section_file_order) {
+			const auto& shdr = elf.sections[section_index].hdr;
+			if (shdr.sh_offset && shdr.sh_offset != offsets[section_index]) {
+				printf("WARN: section %zu moved while writing!\n", section_index);
+				os.seekp(0);
+				writerpx(elf, os);
+				return;
+			}
+		}
+
+		for (const auto& section : elf.sections) {
+			if (section.hdr.sh_type != SHT_RPL_CRCS || !section.hdr.sh_offset) continue;
+			os.seekp(section.hdr.sh_offset.value());
+			os.write((const char*)section.data.view().data(), section.data.size());
+		}
+		os.seekp(0);
+		rpx_write_headers(elf, os);
+
+		//if file length is not aligned to 0x40, pad end of file
+		const auto& last = elf.sections[elf.section_file_order.back()].hdr;
+		size_t end = last.sh_offset.value() + last.sh_size.value();
+		if (end & (0x40 - 1)) {
+			os.seekp(alignup(end, 0x40) - 1);
+			os.put(0x00);
+		}
+		RPX_TIMER_BYTES_OUT(timer, writerpxsize(elf));
+	});
+}
@@ -0,0 +1,65 @@
+// Copyright (C) 2020 Ash Logan <ash@heyquark.com>
+// Licensed under the terms of the GNU GPL, version 3
+// http://www.gnu.org/licenses/gpl-3.0.txt
+
+#pragma once
+
+#include "rpx.hpp"
+#include <span>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+//the compression library doing the actual work. exactly one of the
+//backend_*.cpp files gets built, picked by WIIURPX_BACKEND in CMake.
+//all of these are safe to call from several threads at once.
+namespace backend {
+
+//name of the library, i.e. "zlib"
+const char* name();
+
+//upper bound on the size of a zlib stream holding len bytes
+size_t deflate_bound(size_t len, const rpx::deflate_settings& settings);
+
+//the deflate functions can hand each piece of their input to this just before
+//it's compressed, and inflate each piece of output just after it's made - so
+//a checksum can be done while the data is still in cache, instead of going
+//over all of it again. the pieces are in order and cover everything, unless
+//there's an error partway.
+typedef std::function<void(std::span<const uint8_t>)> chunk_fn;
+
+//deflates in into out as a complete zlib stream (header, data, adler32).
+//returns the number of bytes written to out, or 0 if it didn't fit.
+size_t deflate(std::span<const uint8_t> in, std::span<uint8_t> out, const rpx::deflate_settings& settings,
+	const chunk_fn& consumed = nullptr);
+
+//deflates in as a complete zlib stream, same as deflate(), but hands the
+//output to sink a piece at a time instead of needing room for all of it.
+//returns the total size of the stream, or 0 on error.
+size_t deflate_stream(std::span<const uint8_t> in, const rpx::deflate_settings& settings,
+	const std::function<void(std::span<const uint8_t>)>& sink, const chunk_fn& consumed = nullptr);
+
+//whether deflate_block works. it needs preset dictionaries, which not every
+//library has.
+bool can_deflate_blocks();
+
+//deflates one piece of a bigger buffer as raw deflate data (no zlib header or
+//adler32), carrying on from dict - the bytes just before it. unless it's the
+//last piece, the output ends on a byte boundary so pieces can be stuck
+//together. appends to out, and returns false on error.
+bool deflate_block(std::span<const uint8_t> dict, std::span<const uint8_t> in, bool last,
+	std::vector<uint8_t>& out, const rpx::deflate_settings& settings, const chunk_fn& consumed = nullptr);
+
+//inflates a zlib stream that decompresses to exactly out_size bytes, handing
+//the output to sink a piece at a time as it's made. returns false if the
+//stream is broken or the size doesn't match (sink may have been called by
+//then).
+bool inflate_stream(std::span<const uint8_t> in, size_t out_size,
+	const std::function<void(std::span<const uint8_t>)>& sink);
+
+//inflates a zlib stream that decompresses to exactly out.size() bytes.
+//returns false if the stream is broken or the size doesn't match.
+bool inflate(std::span<const uint8_t> in, std::span<uint8_t> out, const chunk_fn& produced = nullptr);
+
+}
@@ -0,0 +1,100 @@
+// Copyright (C) 2020 Ash Logan <ash@heyquark.com>
+// Licensed under the terms of the GNU GPL, version 3
+// http://www.gnu.org/licenses/gpl-3.0.txt
+
+//backend for libdeflate. it only does whole buffers at once, which is all
+//compress and decompress need anyway.
+
+#include "backend.hpp"
+
+#include <libdeflate.h>
+#include <memory>
+#include <vector>
+
+namespace {
+
+struct compressor_deleter {
+	void operator()(libdeflate_compressor* c) { libdeflate_free_compressor(c); }
+};
+struct decompressor_deleter {
+	void operator()(libdeflate_decompressor* d) { libdeflate_free_decompressor(d); }
+};
+
+//(de)compressors aren't thread safe, so each thread keeps its own
+thread_local std::unique_ptr<libdeflate_compressor, compressor_deleter> compressor;
+thread_local int compressor_level = -1;
+thread_local std::unique_ptr<libdeflate_decompressor, decompressor_deleter> decompressor;
+
+libdeflate_compressor* get_compressor(int level) {
+	//libdeflate has no "default" level, zlib's is 6
+	if (level < 0) level = 6;
+	if (level > 12) level = 12;
+	if (!compressor || compressor_level != level) {
+		compressor.reset(libdeflate_alloc_compressor(level));
+		compressor_level = level;
+	}
+	return compressor.get();
+}
+
+}
+
+const char* backend::name() {
+	return "libdeflate";
+}
+
+size_t backend::deflate_bound(size_t len, const rpx::deflate_settings& settings) {
+	//NULL gives a bound good for any compression level
+	return libdeflate_zlib_compress_bound(nullptr, len);
+}
+
+//strategy, mem_level and window_bits have no equivalent here. the callbacks
+//get everything in one piece, since libdeflate won't take it any smaller.
+size_t backend::deflate(std::span<const uint8_t> in, std::span<uint8_t> out, const rpx::deflate_settings& settings,
+	const chunk_fn& consumed) {
+	auto c = get_compressor(settings.level);
+	if (!c) return 0;
+	if (consumed) consumed(in);
+	return libdeflate_zlib_compress(c, in.data(), in.size(), out.data(), out.size());
+}
+
+//libdeflate can't stream, so this needs room for the whole compressed
+//section - still better than the whole rpx
+size_t backend::deflate_stream(std::span<const uint8_t> in, const rpx::deflate_settings& settings,
+	const std::function<void(std::span<const uint8_t>)>& sink, const chunk_fn& consumed) {
+	std::vector<uint8_t> out(deflate_bound(in.size(), settings));
+	size_t written = deflate(in, out, settings, consumed);
+	if (written) sink(std::span(out).first(written));
+	return written;
+}
+
+//no way to give libdeflate a dictionary, so compress() deflates big sections
+//in one go instead
+bool backend::can_deflate_blocks() {
+	return false;
+}
+
+bool backend::deflate_block(std::span<const uint8_t> dict, std::span<const uint8_t> in, bool last,
+	std::vector<uint8_t>& out, const rpx::deflate_settings& settings, const chunk_fn& consumed) {
+	return false;
+}
+
+bool backend::inflate(std::span<const uint8_t> in, std::span<uint8_t> out, const chunk_fn& produced) {
+	if (!decompressor) decompressor.reset(libdeflate_alloc_decompressor());
+	if (!decompressor) return false;
+
+	//passing no actual_out_nbytes makes libdeflate insist on an exact fit
+	auto ret = libdeflate_zlib_decompress(decompressor.get(),
+		in.data(), in.size(), out.data(), out.size(), nullptr);
+	if (ret != LIBDEFLATE_SUCCESS) return false;
+	if (produced) produced(out);
+	return true;
+}
+
+//same as deflate_stream - it all has to be in memory at once
+bool backend::inflate_stream(std::span<const uint8_t> in, size_t out_size,
+	const std::function<void(std::span<const uint8_t>)>& sink) {
+	std::vector<uint8_t> out(out_size);
+	if (!inflate(in, out)) return false;
+	sink(out);
+	return true;
+}
@@ -0,0 +1,210 @@
+// Copyright (C) 2020 Ash Logan <ash@heyquark.com>
+// Licensed under the terms of the GNU GPL, version 3
+// http://www.gnu.org/licenses/gpl-3.0.txt
+
+//backend for zlib, or zlib-ng's native (zng_ prefixed) api
+
+#include "backend.hpp"
+
+#include <algorithm>
+
+#ifdef WIIURPX_BACKEND_ZLIB_NG
+#include <zlib-ng.h>
+#define ZFN(name) zng_ ## name
+typedef zng_stream zstream_t;
+#else
+#include <zlib.h>
+#define ZFN(name) name
+typedef z_stream zstream_t;
+#endif
+
+#define CHUNK 16384
+//how much the deflate functions take in at a time, and inflate puts out, when
+//there's a chunk_fn watching - small enough to still be in cache after
+#define PIECE (CHUNK * 8)
+
+const char* backend::name() {
+#ifdef WIIURPX_BACKEND_ZLIB_NG
+	return "zlib-ng";
+#else
+	return "zlib";
+#endif
+}
+
+size_t backend::deflate_bound(size_t len, const rpx::deflate_settings& settings) {
+	//deflateBound with default settings, no stream needed
+	if (settings.window_bits == 15 && settings.mem_level == 8) {
+		return ZFN(compressBound)(len);
+	}
+	//deflateBound's conservative guess for anything else (+6 for the header
+	//and adler32)
+	return len + ((len + 7) >> 3) + ((len + 63) >> 6) + 5 + 6;
+}
+
+size_t backend::deflate(std::span<const uint8_t> in, std::span<uint8_t> out, const rpx::deflate_settings& settings,
+	const chunk_fn& consumed) {
+	zstream_t zstream = { 0 };
+	if (ZFN(deflateInit2)(&zstream, settings.level, Z_DEFLATED,
+		settings.window_bits, settings.mem_level, settings.strategy) != Z_OK) return 0;
+
+	zstream.avail_out = out.size();
+	zstream.next_out = (uint8_t*)out.data();
+
+	//pass to zlib - all at once, unless someone wants to see it go by. given
+	//deflate_bound, there's always room for it to take the whole piece.
+	size_t piece_size = consumed ? PIECE : in.size();
+	size_t pos = 0;
+	int zret;
+	do {
+		auto piece = in.subspan(pos, std::min(piece_size, in.size() - pos));
+		pos += piece.size();
+		if (consumed) consumed(piece);
+
+		zstream.avail_in = piece.size();
+		zstream.next_in = (uint8_t*)piece.data();
+		zret = ZFN(deflate)(&zstream, pos == in.size() ? Z_FINISH : Z_NO_FLUSH);
+	} while (pos < in.size() && zret == Z_OK && zstream.avail_in == 0);
+	size_t written = zstream.total_out;
+
+	ZFN(deflateEnd)(&zstream);
+
+	if (zret != Z_STREAM_END) return 0;
+	return written;
+}
+
+//feeds in through a deflate stream that's all set up, a piece at a time (so
+//consumed sees each one just before zlib does), finishing up with flush.
+//returns zlib's last word - Z_STREAM_END for Z_FINISH, Z_OK otherwise.
+static int deflate_pieces(zstream_t& zstream, std::span<const uint8_t> in, int flush,
+	const std::function<void(std::span<const uint8_t>)>& sink, const backend::chunk_fn& consumed) {
+	size_t piece_size = consumed ? PIECE : in.size();
+	size_t pos = 0;
+	uint8_t chunk[CHUNK];
+	int zret;
+	int piece_flush;
+	do {
+		auto piece = in.subspan(pos, std::min(piece_size, in.size() - pos));
+		pos += piece.size();
+		if (consumed) consumed(piece);
+
+		zstream.avail_in = piece.size();
+		zstream.next_in = (uint8_t*)piece.data();
+		piece_flush = pos == in.size() ? flush : Z_NO_FLUSH;
+
+		//until zlib has taken all the piece (and finished, on the last one)
+		do {
+			zstream.avail_out = sizeof(chunk);
+			zstream.next_out = chunk;
+			zret = ZFN(deflate)(&zstream, piece_flush);
+			//nothing left to flush - the last go filled the chunk exactly
+			if (zret == Z_BUF_ERROR && piece_flush != Z_FINISH) {
+				zret = Z_OK;
+				break;
+			}
+			if (zret != Z_OK && zret != Z_STREAM_END) break;
+
+			sink(std::span(chunk, sizeof(chunk) - zstream.avail_out));
+		} while (piece_flush == Z_FINISH ? zret != Z_STREAM_END : zstream.avail_out == 0);
+	} while (piece_flush != flush && zret == Z_OK);
+	return zret;
+}
+
+size_t backend::deflate_stream(std::span<const uint8_t> in, const rpx::deflate_settings& settings,
+	const std::function<void(std::span<const uint8_t>)>& sink, const chunk_fn& consumed) {
+	zstream_t zstream = { 0 };
+	if (ZFN(deflateInit2)(&zstream, settings.level, Z_DEFLATED,
+		settings.window_bits, settings.mem_level, settings.strategy) != Z_OK) return 0;
+
+	int zret = deflate_pieces(zstream, in, Z_FINISH, sink, consumed);
+	size_t written = zstream.total_out;
+
+	ZFN(deflateEnd)(&zstream);
+
+	if (zret != Z_STREAM_END) return 0;
+	return written;
+}
+
+bool backend::can_deflate_blocks() {
+	return true;
+}
+
+bool backend::deflate_block(std::span<const uint8_t> dict, std::span<const uint8_t> in, bool last,
+	std::vector<uint8_t>& out, const rpx::deflate_settings& settings, const chunk_fn& consumed) {
+	zstream_t zstream = { 0 };
+	//negative window bits for raw deflate - the caller sorts out the header
+	if (ZFN(deflateInit2)(&zstream, settings.level, Z_DEFLATED,
+		-settings.window_bits, settings.mem_level, settings.strategy) != Z_OK) return false;
+
+	//only the last window's worth of the dictionary can be referred back to
+	if (!dict.empty()) {
+		size_t window = (size_t)1 << settings.window_bits;
+		if (dict.size() > window) dict = dict.last(window);
+		ZFN(deflateSetDictionary)(&zstream, dict.data(), dict.size());
+	}
+
+	//a sync flush finishes on a byte boundary, without marking the last block
+	int zret = deflate_pieces(zstream, in, last ? Z_FINISH : Z_SYNC_FLUSH,
+		[&](std::span<const uint8_t> chunk) {
+			out.insert(out.end(), chunk.begin(), chunk.end());
+		}, consumed);
+
+	ZFN(deflateEnd)(&zstream);
+
+	return last ? zret == Z_STREAM_END : zret == Z_OK;
+}
+
+bool backend::inflate(std::span<const uint8_t> in, std::span<uint8_t> out, const chunk_fn& produced) {
+	zstream_t zstream = { 0 };
+	if (ZFN(inflateInit)(&zstream) != Z_OK) return false;
+
+	zstream.avail_in = in.size();
+	zstream.next_in = (uint8_t*)in.data();
+
+	//we know the exact size, so one go is enough - unless someone wants to see
+	//each piece as it's made. Z_FINISH lets zlib skip keeping its window up to
+	//date, so that's only for the one go.
+	size_t piece_size = produced ? PIECE : out.size();
+	int flush = produced ? Z_NO_FLUSH : Z_FINISH;
+	int zret;
+	do {
+		size_t done = zstream.total_out;
+		zstream.avail_out = std::min(piece_size, out.size() - done);
+		zstream.next_out = (uint8_t*)out.data() + done;
+		zret = ZFN(inflate)(&zstream, flush);
+		if (zret != Z_OK && zret != Z_STREAM_END) break;
+
+		if (produced) produced(out.subspan(done, zstream.total_out - done));
+	} while (zret != Z_STREAM_END);
+	bool ok = zret == Z_STREAM_END && zstream.total_out == out.size();
+
+	ZFN(inflateEnd)(&zstream);
+
+	return ok;
+}
+
+bool backend::inflate_stream(std::span<const uint8_t> in, size_t out_size,
+	const std::function<void(std::span<const uint8_t>)>& sink) {
+	zstream_t zstream = { 0 };
+	if (ZFN(inflateInit)(&zstream) != Z_OK) return false;
+
+	zstream.avail_in = in.size();
+	zstream.next_in = (uint8_t*)in.data();
+
+	//zlib keeps its own copy of the window, so the chunk can be reused
+	uint8_t chunk[CHUNK * 4];
+	int zret;
+	do {
+		zstream.avail_out = sizeof(chunk);
+		zstream.next_out = chunk;
+		zret = ZFN(inflate)(&zstream, Z_NO_FLUSH);
+		if (zret != Z_OK && zret != Z_STREAM_END) break;
+		if (zstream.total_out > out_size) break;
+
+		sink(std::span(chunk, sizeof(chunk) - zstream.avail_out));
+	} while (zret != Z_STREAM_END);
+	bool ok = zret == Z_STREAM_END && zstream.total_out == out_size;
+
+	ZFN(inflateEnd)(&zstream);
+
+	return ok;
+}
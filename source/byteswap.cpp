@@ -0,0 +1,250 @@
+// Copyright (C) 2020 Ash Logan <ash@heyquark.com>
+// Licensed under the terms of the GNU GPL, version 3
+// http://www.gnu.org/licenses/gpl-3.0.txt
+
+#include "rpx.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BYTESWAP_HAVE_X86 1
+#include <immintrin.h>
+#endif
+#if defined(__GNUC__) && defined(__aarch64__)
+#define BYTESWAP_HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+using namespace rpx;
+
+//every conversion is a shuffle of the bytes within each 16 byte block - out[i]
+//= in[mask[i]] - with the same pattern for every block. an array of uint32s
+//repeats every 4 bytes, an Elf32_Sym every 16, and so on. len is always a
+//whole number of elements, so a short tail still lines up with the mask.
+typedef void (*shuffle_fn)(const uint8_t* in, uint8_t* out, size_t len, const uint8_t* mask);
+
+alignas(16) static const uint8_t swap16_mask[16] = { 1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14 };
+alignas(16) static const uint8_t swap32_mask[16] = { 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 };
+//st_name, st_value, st_size, st_info, st_other, st_shndx
+alignas(16) static const uint8_t sym_mask[16] = { 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 12, 13, 15, 14 };
+
+static_assert(sizeof(Elf32_Sym) == 16 && sizeof(native::Elf32_Sym) == 16);
+static_assert(sizeof(Elf32_Rela) == 12 && sizeof(native::Elf32_Rela) == 12);
+static_assert(sizeof(Elf32_Shdr) == 40 && sizeof(native::Elf32_Shdr) == 40);
+
+static void shuffle_tail(const uint8_t* in, uint8_t* out, size_t len, const uint8_t* mask) {
+	//in and out might be the same memory, so read it all before writing
+	uint8_t block[16];
+	memcpy(block, in, len);
+	for (size_t i = 0; i < len; i++) out[i] = block[mask[i]];
+}
+
+//compilers turn these into a single bswap/rev
+static inline uint32_t swap32(uint32_t v) {
+	return (v >> 24) | ((v >> 8) & 0xFF00) | ((v << 8) & 0xFF0000) | (v << 24);
+}
+static inline uint16_t swap16(uint16_t v) {
+	return (uint16_t)((v >> 8) | (v << 8));
+}
+
+//no SIMD - a byte at a time is slow, so the common patterns get whole words
+static void shuffle_scalar(const uint8_t* in, uint8_t* out, size_t len, const uint8_t* mask) {
+	if (mask == swap32_mask) {
+		for (; len >= 4; in += 4, out += 4, len -= 4) {
+			uint32_t v;
+			memcpy(&v, in, sizeof(v));
+			v = swap32(v);
+			memcpy(out, &v, sizeof(v));
+		}
+	} else if (mask == swap16_mask) {
+		for (; len >= 2; in += 2, out += 2, len -= 2) {
+			uint16_t v;
+			memcpy(&v, in, sizeof(v));
+			v = swap16(v);
+			memcpy(out, &v, sizeof(v));
+		}
+	} else if (mask == sym_mask) {
+		for (; len >= 16; in += 16, out += 16, len -= 16) {
+			uint32_t w[3];
+			uint16_t h[2];
+			memcpy(w, in, sizeof(w));
+			memcpy(h, in + 12, sizeof(h));
+			w[0] = swap32(w[0]);
+			w[1] = swap32(w[1]);
+			w[2] = swap32(w[2]);
+			h[1] = swap16(h[1]);
+			memcpy(out, w, sizeof(w));
+			memcpy(out + 12, h, sizeof(h));
+		}
+	}
+	while (len >= 16) {
+		shuffle_tail(in, out, 16, mask);
+		in += 16;
+		out += 16;
+		len -= 16;
+	}
+	if (len) shuffle_tail(in, out, len, mask);
+}
+
+#ifdef BYTESWAP_HAVE_X86
+__attribute__((target("ssse3")))
+static void shuffle_ssse3(const uint8_t* in, uint8_t* out, size_t len, const uint8_t* mask) {
+	__m128i m = _mm_load_si128((const __m128i*)mask);
+	while (len >= 64) {
+		__m128i a = _mm_loadu_si128((const __m128i*)(in + 0x00));
+		__m128i b = _mm_loadu_si128((const __m128i*)(in + 0x10));
+		__m128i c = _mm_loadu_si128((const __m128i*)(in + 0x20));
+		__m128i d = _mm_loadu_si128((const __m128i*)(in + 0x30));
+		_mm_storeu_si128((__m128i*)(out + 0x00), _mm_shuffle_epi8(a, m));
+		_mm_storeu_si128((__m128i*)(out + 0x10), _mm_shuffle_epi8(b, m));
+		_mm_storeu_si128((__m128i*)(out + 0x20), _mm_shuffle_epi8(c, m));
+		_mm_storeu_si128((__m128i*)(out + 0x30), _mm_shuffle_epi8(d, m));
+		in += 64;
+		out += 64;
+		len -= 64;
+	}
+	while (len >= 16) {
+		__m128i a = _mm_loadu_si128((const __m128i*)in);
+		_mm_storeu_si128((__m128i*)out, _mm_shuffle_epi8(a, m));
+		in += 16;
+		out += 16;
+		len -= 16;
+	}
+	if (len) shuffle_tail(in, out, len, mask);
+}
+
+__attribute__((target("avx2")))
+static void shuffle_avx2(const uint8_t* in, uint8_t* out, size_t len, const uint8_t* mask) {
+	//vpshufb works on each 128 bit lane separately, which is just what we want
+	__m256i m = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i*)mask));
+	while (len >= 128) {
+		__m256i a = _mm256_loadu_si256((const __m256i*)(in + 0x00));
+		__m256i b = _mm256_loadu_si256((const __m256i*)(in + 0x20));
+		__m256i c = _mm256_loadu_si256((const __m256i*)(in + 0x40));
+		__m256i d = _mm256_loadu_si256((const __m256i*)(in + 0x60));
+		_mm256_storeu_si256((__m256i*)(out + 0x00), _mm256_shuffle_epi8(a, m));
+		_mm256_storeu_si256((__m256i*)(out + 0x20), _mm256_shuffle_epi8(b, m));
+		_mm256_storeu_si256((__m256i*)(out + 0x40), _mm256_shuffle_epi8(c, m));
+		_mm256_storeu_si256((__m256i*)(out + 0x60), _mm256_shuffle_epi8(d, m));
+		in += 128;
+		out += 128;
+		len -= 128;
+	}
+	while (len >= 32) {
+		__m256i a = _mm256_loadu_si256((const __m256i*)in);
+		_mm256_storeu_si256((__m256i*)out, _mm256_shuffle_epi8(a, m));
+		in += 32;
+		out += 32;
+		len -= 32;
+	}
+	shuffle_ssse3(in, out, len, mask);
+}
+#endif
+
+#ifdef BYTESWAP_HAVE_NEON
+static void shuffle_neon(const uint8_t* in, uint8_t* out, size_t len, const uint8_t* mask) {
+	uint8x16_t m = vld1q_u8(mask);
+	while (len >= 64) {
+		uint8x16_t a = vld1q_u8(in + 0x00);
+		uint8x16_t b = vld1q_u8(in + 0x10);
+		uint8x16_t c = vld1q_u8(in + 0x20);
+		uint8x16_t d = vld1q_u8(in + 0x30);
+		vst1q_u8(out + 0x00, vqtbl1q_u8(a, m));
+		vst1q_u8(out + 0x10, vqtbl1q_u8(b, m));
+		vst1q_u8(out + 0x20, vqtbl1q_u8(c, m));
+		vst1q_u8(out + 0x30, vqtbl1q_u8(d, m));
+		in += 64;
+		out += 64;
+		len -= 64;
+	}
+	while (len >= 16) {
+		vst1q_u8(out, vqtbl1q_u8(vld1q_u8(in), m));
+		in += 16;
+		out += 16;
+		len -= 16;
+	}
+	if (len) shuffle_tail(in, out, len, mask);
+}
+#endif
+
+struct byteswap_engine_t {
+	shuffle_fn fn;
+	const char* name;
+};
+
+static byteswap_engine_t pick_byteswap_engine() {
+#ifdef BYTESWAP_HAVE_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) return { shuffle_avx2, "avx2" };
+	if (__builtin_cpu_supports("ssse3")) return { shuffle_ssse3, "ssse3" };
+#endif
+#ifdef BYTESWAP_HAVE_NEON
+	//always there on aarch64
+	return { shuffle_neon, "neon" };
+#endif
+	return { shuffle_scalar, "scalar" };
+}
+
+static const byteswap_engine_t& byteswap_engine_impl() {
+	static const byteswap_engine_t engine = pick_byteswap_engine();
+	return engine;
+}
+
+//count elements of elem_size bytes each
+static void convert(const void* in, void* out, size_t count, size_t elem_size, const uint8_t* mask) {
+	size_t len = count * elem_size;
+	if (!len) return;
+	//big endian hosts have nothing to do
+	if constexpr (std::endian::native == std::endian::big) {
+		memmove(out, in, len);
+	} else {
+		byteswap_engine_impl().fn((const uint8_t*)in, (uint8_t*)out, len, mask);
+	}
+}
+
+template <typename In, typename Out>
+static void convert(std::span<In> in, std::span<Out> out, const uint8_t* mask, size_t words_per_elem = 1) {
+	static_assert(sizeof(In) == sizeof(Out));
+	size_t count = std::min(in.size(), out.size());
+	convert(in.data(), out.data(), count * words_per_elem, sizeof(In) / words_per_elem, mask);
+}
+
+void rpx::from_be(std::span<const be2_val<uint16_t>> in, std::span<uint16_t> out) {
+	convert(in, out, swap16_mask);
+}
+void rpx::from_be(std::span<const be2_val<uint32_t>> in, std::span<uint32_t> out) {
+	convert(in, out, swap32_mask);
+}
+//these two are nothing but uint32s
+void rpx::from_be(std::span<const Elf32_Shdr> in, std::span<native::Elf32_Shdr> out) {
+	convert(in, out, swap32_mask, sizeof(Elf32_Shdr) / sizeof(uint32_t));
+}
+void rpx::from_be(std::span<const Elf32_Rela> in, std::span<native::Elf32_Rela> out) {
+	convert(in, out, swap32_mask, sizeof(Elf32_Rela) / sizeof(uint32_t));
+}
+void rpx::from_be(std::span<const Elf32_Sym> in, std::span<native::Elf32_Sym> out) {
+	convert(in, out, sym_mask);
+}
+
+//swapping is its own inverse, so these are the same thing backwards
+void rpx::to_be(std::span<const uint16_t> in, std::span<be2_val<uint16_t>> out) {
+	convert(in, out, swap16_mask);
+}
+void rpx::to_be(std::span<const uint32_t> in, std::span<be2_val<uint32_t>> out) {
+	convert(in, out, swap32_mask);
+}
+void rpx::to_be(std::span<const native::Elf32_Shdr> in, std::span<Elf32_Shdr> out) {
+	convert(in, out, swap32_mask, sizeof(Elf32_Shdr) / sizeof(uint32_t));
+}
+void rpx::to_be(std::span<const native::Elf32_Rela> in, std::span<Elf32_Rela> out) {
+	convert(in, out, swap32_mask, sizeof(Elf32_Rela) / sizeof(uint32_t));
+}
+void rpx::to_be(std::span<const native::Elf32_Sym> in, std::span<Elf32_Sym> out) {
+	convert(in, out, sym_mask);
+}
+
+const char* rpx::byteswap_engine() {
+	return byteswap_engine_impl().name;
+}
@@ -0,0 +1,272 @@
+// Copyright (C) 2020 Ash Logan <ash@heyquark.com>
+// Licensed under the terms of the GNU GPL, version 3
+// http://www.gnu.org/licenses/gpl-3.0.txt
+
+#include "rpx.hpp"
+#include "crc32.hpp"
+
+#ifdef CRC32_HAVE_PCLMUL
+#include <immintrin.h>
+#endif
+#ifdef CRC32_HAVE_ARMV8
+#include <arm_acle.h>
+#if defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#endif
+
+static inline uint32_t load_le32(const uint8_t* p) {
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+uint32_t crc32_bytewise(uint32_t crc, const uint8_t* data, size_t len) {
+	const auto& t = crc_tables[0];
+	for (size_t i = 0; i < len; i++) {
+		crc = (crc >> 8) ^ t[(crc ^ data[i]) & 0xFF];
+	}
+	return crc;
+}
+
+uint32_t crc32_slice16(uint32_t crc, const uint8_t* data, size_t len) {
+	const auto& t = crc_tables;
+	//16 bytes per go, each through its own table
+	while (len >= 16) {
+		uint32_t a = load_le32(data + 0) ^ crc;
+		uint32_t b = load_le32(data + 4);
+		uint32_t c = load_le32(data + 8);
+		uint32_t d = load_le32(data + 12);
+		crc = t[15][a & 0xFF] ^ t[14][(a >> 8) & 0xFF] ^ t[13][(a >> 16) & 0xFF] ^ t[12][a >> 24] ^
+		      t[11][b & 0xFF] ^ t[10][(b >> 8) & 0xFF] ^ t[ 9][(b >> 16) & 0xFF] ^ t[ 8][b >> 24] ^
+		      t[ 7][c & 0xFF] ^ t[ 6][(c >> 8) & 0xFF] ^ t[ 5][(c >> 16) & 0xFF] ^ t[ 4][c >> 24] ^
+		      t[ 3][d & 0xFF] ^ t[ 2][(d >> 8) & 0xFF] ^ t[ 1][(d >> 16) & 0xFF] ^ t[ 0][d >> 24];
+		data += 16;
+		len -= 16;
+	}
+	if (len >= 8) {
+		uint32_t a = load_le32(data + 0) ^ crc;
+		uint32_t b = load_le32(data + 4);
+		crc = t[7][a & 0xFF] ^ t[6][(a >> 8) & 0xFF] ^ t[5][(a >> 16) & 0xFF] ^ t[4][a >> 24] ^
+		      t[3][b & 0xFF] ^ t[2][(b >> 8) & 0xFF] ^ t[1][(b >> 16) & 0xFF] ^ t[0][b >> 24];
+		data += 8;
+		len -= 8;
+	}
+	return crc32_bytewise(crc, data, len);
+}
+
+#ifdef CRC32_HAVE_PCLMUL
+//carry-less multiply folding, from Intel's "Fast CRC Computation for Generic
+//Polynomials Using PCLMULQDQ Instruction". constants are for the reflected
+//0xedb88320 polynomial.
+__attribute__((target("pclmul,sse4.1")))
+uint32_t crc32_pclmul(uint32_t crc, const uint8_t* data, size_t len) {
+	alignas(16) static const uint64_t k1k2[] = { 0x0154442bd4, 0x01c6e41596 };
+	alignas(16) static const uint64_t k3k4[] = { 0x01751997d0, 0x00ccaa009e };
+	alignas(16) static const uint64_t k5k0[] = { 0x0163cd6124, 0x0000000000 };
+	alignas(16) static const uint64_t poly[] = { 0x01db710641, 0x01f7011641 };
+
+	__m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+	//always at least 64 bytes to start with
+	x1 = _mm_loadu_si128((const __m128i*)(data + 0x00));
+	x2 = _mm_loadu_si128((const __m128i*)(data + 0x10));
+	x3 = _mm_loadu_si128((const __m128i*)(data + 0x20));
+	x4 = _mm_loadu_si128((const __m128i*)(data + 0x30));
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+	x0 = _mm_load_si128((const __m128i*)k1k2);
+	data += 64;
+	len -= 64;
+
+	//fold 4x128 bits at a time
+	while (len >= 64) {
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+		x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+		x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+		y5 = _mm_loadu_si128((const __m128i*)(data + 0x00));
+		y6 = _mm_loadu_si128((const __m128i*)(data + 0x10));
+		y7 = _mm_loadu_si128((const __m128i*)(data + 0x20));
+		y8 = _mm_loadu_si128((const __m128i*)(data + 0x30));
+
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+
+		data += 64;
+		len -= 64;
+	}
+
+	//fold the four lanes down into one
+	x0 = _mm_load_si128((const __m128i*)k3k4);
+
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+	//any leftover 16 byte blocks
+	while (len >= 16) {
+		x2 = _mm_loadu_si128((const __m128i*)data);
+
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+		data += 16;
+		len -= 16;
+	}
+
+	//128 bits down to 64
+	x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+	x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+	x1 = _mm_srli_si128(x1, 8);
+	x1 = _mm_xor_si128(x1, x2);
+
+	x0 = _mm_loadl_epi64((const __m128i*)k5k0);
+
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, x3);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	//barrett reduction down to 32
+	x0 = _mm_load_si128((const __m128i*)poly);
+
+	x2 = _mm_and_si128(x1, x3);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+	x2 = _mm_and_si128(x2, x3);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	return _mm_extract_epi32(x1, 1);
+}
+
+static uint32_t crc32_pclmul_any(uint32_t crc, const uint8_t* data, size_t len) {
+	if (len < 64) return crc32_slice16(crc, data, len);
+
+	size_t folded = len & ~(size_t)15;
+	crc = crc32_pclmul(crc, data, folded);
+	return crc32_bytewise(crc, data + folded, len - folded);
+}
+#endif
+
+#ifdef CRC32_HAVE_ARMV8
+__attribute__((target("+crc")))
+uint32_t crc32_armv8(uint32_t crc, const uint8_t* data, size_t len) {
+	while (len && ((uintptr_t)data & 7)) {
+		crc = __crc32b(crc, *data++);
+		len--;
+	}
+	while (len >= 32) {
+		const uint64_t* p = (const uint64_t*)data;
+		crc = __crc32d(crc, p[0]);
+		crc = __crc32d(crc, p[1]);
+		crc = __crc32d(crc, p[2]);
+		crc = __crc32d(crc, p[3]);
+		data += 32;
+		len -= 32;
+	}
+	while (len >= 8) {
+		crc = __crc32d(crc, *(const uint64_t*)data);
+		data += 8;
+		len -= 8;
+	}
+	while (len--) {
+		crc = __crc32b(crc, *data++);
+	}
+	return crc;
+}
+#endif
+
+typedef uint32_t (*crc32_fn)(uint32_t crc, const uint8_t* data, size_t len);
+struct crc32_engine_t {
+	crc32_fn fn;
+	const char* name;
+};
+
+static crc32_engine_t pick_crc32_engine() {
+#ifdef CRC32_HAVE_PCLMUL
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1")) {
+		return { crc32_pclmul_any, "pclmul" };
+	}
+#endif
+#ifdef CRC32_HAVE_ARMV8
+#if defined(__ARM_FEATURE_CRC32) || defined(__APPLE__)
+	return { crc32_armv8, "armv8-crc" };
+#elif defined(__linux__)
+	if (getauxval(AT_HWCAP) & HWCAP_CRC32) {
+		return { crc32_armv8, "armv8-crc" };
+	}
+#endif
+#endif
+	return { crc32_slice16, "slice16" };
+}
+
+static const crc32_engine_t& crc32_engine_impl() {
+	static const crc32_engine_t engine = pick_crc32_engine();
+	return engine;
+}
+
+uint32_t rpx::crc32(uint32_t crc, std::span<const uint8_t> data) {
+	if (data.empty()) return crc;
+	return ~crc32_engine_impl().fn(~crc, data.data(), data.size());
+}
+
+//crc32_combine works with polynomials mod the crc polynomial (reflected, so
+//bit 31 is x^0), like zlib does
+static constexpr uint32_t multmodp(uint32_t a, uint32_t b) {
+	uint32_t m = 1u << 31, p = 0;
+	for (;;) {
+		if (a & m) {
+			p ^= b;
+			if ((a & (m - 1)) == 0) break;
+		}
+		m >>= 1;
+		b = b & 1 ? (b >> 1) ^ 0xedb88320 : b >> 1;
+	}
+	return p;
+}
+
+//x2n_table[k] is x^(2^k) mod p
+static constexpr std::array<uint32_t, 32> x2n_table = [] {
+	std::array<uint32_t, 32> table {};
+	uint32_t p = 1u << 30; //x^1
+	table[0] = p;
+	for (size_t n = 1; n < table.size(); n++) table[n] = p = multmodp(p, p);
+	return table;
+}();
+
+//x^(n * 2^k) mod p
+static uint32_t x2nmodp(uint64_t n, unsigned int k) {
+	uint32_t p = 1u << 31; //x^0
+	while (n) {
+		if (n & 1) p = multmodp(x2n_table[k & 31], p);
+		n >>= 1;
+		k++;
+	}
+	return p;
+}
+
+uint32_t rpx::crc32_combine(uint32_t crc1, uint32_t crc2, size_t len2) {
+	//shift crc1 along by len2 zero bytes, then add crc2
+	return multmodp(x2nmodp(len2, 3), crc1) ^ crc2;
+}
+
+const char* rpx::crc32_engine() {
+	return crc32_engine_impl().name;
+}
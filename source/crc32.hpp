@@ -4,25 +4,48 @@
 
 #pragma once
 
-#include <iterator>
+#include <array>
 #include <cstdint>
+#include <cstddef>
 
-template <typename InputIterator>
-static uint32_t crc32_rpx(uint32_t crc, InputIterator first, InputIterator last) {
-	uint32_t crc_table[256];
-	for(uint32_t i=0; i<256; i++)
-	{
+//the rpx crc32 is the usual reflected 0xedb88320 one, same as zlib's.
+//tables for slicing-by-16: crc_tables[0] is the classic bytewise table,
+//crc_tables[k] advances a byte through k more zero bytes.
+typedef std::array<std::array<uint32_t, 256>, 16> crc_table_set;
+
+static constexpr crc_table_set make_crc_tables() {
+	crc_table_set tables {};
+	for (uint32_t i = 0; i < 256; i++) {
 		uint32_t c = i;
-		for(uint32_t j=0; j<8; j++)
-		{
-			if(c & 1)
-				c = 0xedb88320L^(c>>1);
+		for (uint32_t j = 0; j < 8; j++) {
+			if (c & 1)
+				c = 0xedb88320L ^ (c >> 1);
 			else
-				c = c>>1;
+				c = c >> 1;
+		}
+		tables[0][i] = c;
+	}
+	for (size_t k = 1; k < tables.size(); k++) {
+		for (uint32_t i = 0; i < 256; i++) {
+			uint32_t c = tables[k - 1][i];
+			tables[k][i] = (c >> 8) ^ tables[0][c & 0xFF];
 		}
-		crc_table[i] = c;
 	}
-	return ~std::accumulate(first, last, ~crc, [&](uint32_t crc, uint8_t val) {
-		return (crc >> 8) ^ crc_table[(crc^val) & 0xFF];
-	});
+	return tables;
 }
+
+inline constexpr crc_table_set crc_tables = make_crc_tables();
+
+//the individual implementations. these all take and return the crc
+//*without* the usual pre/post inversion - rpx::crc32 handles that.
+uint32_t crc32_bytewise(uint32_t crc, const uint8_t* data, size_t len);
+uint32_t crc32_slice16(uint32_t crc, const uint8_t* data, size_t len);
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CRC32_HAVE_PCLMUL 1
+//needs len >= 64, handles multiples of 16 bytes only
+uint32_t crc32_pclmul(uint32_t crc, const uint8_t* data, size_t len);
+#endif
+#if defined(__GNUC__) && defined(__aarch64__)
+#define CRC32_HAVE_ARMV8 1
+uint32_t crc32_armv8(uint32_t crc, const uint8_t* data, size_t len);
+#endif
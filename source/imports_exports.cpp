@@ -0,0 +1,165 @@
+// Copyright (C) 2020 Ash Logan <ash@heyquark.com>
+// Licensed under the terms of the GNU GPL, version 3
+// http://www.gnu.org/licenses/gpl-3.0.txt
+
+#include "rpx.hpp"
+
+#include <cstdio>
+#include <string.h>
+#include "internal.hpp"
+
+using namespace rpx;
+
+namespace {
+
+//SHT_RPL_EXPORTS starts with this, then count rpl_export_entrys
+struct rpl_export_header {
+	be2_val<uint32_t> count;
+	be2_val<uint32_t> signature;
+};
+struct rpl_export_entry {
+	be2_val<uint32_t> value;
+	//offset from the start of the section. the top bit marks tls exports.
+	be2_val<uint32_t> name;
+};
+const uint32_t export_tls = 0x80000000;
+
+//SHT_RPL_IMPORTS starts with this, then the library name
+struct rpl_import_header {
+	be2_val<uint32_t> count;
+	be2_val<uint32_t> signature;
+};
+
+template <typename T>
+void build_names(name_table& names, const std::vector<T>& entries) {
+	names.reserve(entries.size());
+	for (size_t i = 0; i < entries.size(); i++) names.insert(entries[i].name, (uint32_t)i);
+}
+
+}
+
+import_export_index::import_export_index(std::vector<rpl_export> exports, std::vector<rpl_library> libraries, std::vector<rpl_import> imports) :
+	export_entries(std::move(exports)), library_entries(std::move(libraries)), import_entries(std::move(imports)) {
+	build_names(export_names, export_entries);
+	build_names(library_names, library_entries);
+	build_names(import_names, import_entries);
+}
+
+const rpl_export* import_export_index::find_export(std::string_view name) const {
+	auto i = export_names.find(name);
+	return i == name_table::npos ? nullptr : &export_entries[i];
+}
+
+const rpl_import* import_export_index::find_import(std::string_view name) const {
+	auto i = import_names.find(name);
+	return i == name_table::npos ? nullptr : &import_entries[i];
+}
+
+const rpl_library* import_export_index::find_library(std::string_view name) const {
+	auto i = library_names.find(name);
+	return i == name_table::npos ? nullptr : &library_entries[i];
+}
+
+static void read_exports(rpx::rpx& elf, size_t index, std::vector<rpl_export>& exports) {
+	auto data = section_contents(elf, index).view();
+	rpl_export_header header;
+	if (data.size() < sizeof(header)) {
+		printf("WARN: export section %zu is too small!\n", index);
+		return;
+	}
+	memcpy(&header, data.data(), sizeof(header));
+
+	size_t count = header.count.value();
+	if (count > (data.size() - sizeof(header)) / sizeof(rpl_export_entry)) {
+		printf("WARN: export section %zu is truncated!\n", index);
+		count = (data.size() - sizeof(header)) / sizeof(rpl_export_entry);
+	}
+
+	//every field is a uint32, so the whole table can be swapped in one go
+	std::vector<uint32_t> entries(count * 2);
+	from_be(std::span((const be2_val<uint32_t>*)(data.data() + sizeof(header)), entries.size()), entries);
+
+	bool function = elf.sections[index].hdr.sh_flags & SHF_EXECINSTR;
+	exports.reserve(exports.size() + count);
+	for (size_t i = 0; i < count; i++) {
+		uint32_t value = entries[i * 2];
+		uint32_t name = entries[i * 2 + 1];
+		exports.push_back({
+			.name = rpx_string(data, name & ~export_tls),
+			.value = value,
+			.function = function,
+			.tls = (name & export_tls) != 0,
+		});
+	}
+}
+
+import_export_index rpx::index_imports_exports(rpx& elf) {
+	std::vector<rpl_export> exports;
+	std::vector<rpl_library> libraries;
+	//which library each import section is, or npos
+	std::vector<uint32_t> section_library(elf.sections.size(), name_table::npos);
+
+	for (size_t i = 0; i < elf.sections.size(); i++) {
+		const auto& hdr = elf.sections[i].hdr;
+		if (hdr.sh_type == SHT_RPL_EXPORTS) {
+			read_exports(elf, i, exports);
+		} else if (hdr.sh_type == SHT_RPL_IMPORTS) {
+			auto data = section_contents(elf, i).view();
+			auto name = rpx_string(data, sizeof(rpl_import_header));
+			if (name.empty()) {
+				printf("WARN: import section %zu has no library name!\n", i);
+				continue;
+			}
+			section_library[i] = (uint32_t)libraries.size();
+			libraries.push_back({
+				.name = name,
+				.section = (uint32_t)i,
+				.function = (hdr.sh_flags & SHF_EXECINSTR) != 0,
+				.first_import = 0,
+				.import_count = 0,
+			});
+		}
+	}
+
+	//the imports themselves are symbols defined in the import sections. only
+	//worth reading the symbol tables if there are any.
+	std::vector<std::vector<rpl_import>> library_imports(libraries.size());
+	std::vector<native::Elf32_Sym> syms;
+	for (size_t i = 0; i < elf.sections.size() && !libraries.empty(); i++) {
+		if (elf.sections[i].hdr.sh_type != SHT_SYMTAB) continue;
+		size_t strtab_index = elf.sections[i].hdr.sh_link.value();
+		if (strtab_index >= elf.sections.size()) {
+			printf("WARN: symbol table %zu has no string table!\n", i);
+			continue;
+		}
+
+		auto symtab = section_contents(elf, i).view();
+		auto strtab = section_contents(elf, strtab_index).view();
+		syms.resize(symtab.size() / sizeof(Elf32_Sym));
+		from_be(std::span((const Elf32_Sym*)symtab.data(), syms.size()), syms);
+
+		for (const auto& sym : syms) {
+			if (sym.st_shndx >= section_library.size()) continue;
+			uint32_t library = section_library[sym.st_shndx];
+			if (library == name_table::npos) continue;
+			//the section symbols for the import sections have no name
+			auto name = rpx_string(strtab, sym.st_name);
+			if (!sym.st_name || name.empty()) continue;
+
+			library_imports[library].push_back({
+				.name = name,
+				.value = sym.st_value,
+				.library = library,
+			});
+		}
+	}
+
+	std::vector<rpl_import> imports;
+	for (size_t i = 0; i < libraries.size(); i++) {
+		libraries[i].first_import = (uint32_t)imports.size();
+		libraries[i].import_count = (uint32_t)library_imports[i].size();
+		imports.insert(imports.end(), library_imports[i].begin(), library_imports[i].end());
+	}
+
+	return import_export_index(std::move(exports), std::move(libraries), std::move(imports));
+}
@@ -0,0 +1,44 @@
+// Copyright (C) 2020 Ash Logan <ash@heyquark.com>
+// Licensed under the terms of the GNU GPL, version 3
+// http://www.gnu.org/licenses/gpl-3.0.txt
+
+#include "instrumentation.hpp"
+
+#ifdef WIIURPX_INSTRUMENTATION
+
+#include <memory>
+#include <mutex>
+
+//the hook is swapped out as a whole, so events already being reported can
+//finish with the old one
+static std::mutex hook_mutex;
+static std::shared_ptr<const rpx::instrumentation_fn> hook;
+
+void rpx::set_instrumentation(instrumentation_fn fn) {
+	std::shared_ptr<const instrumentation_fn> new_hook;
+	if (fn) new_hook = std::make_shared<const instrumentation_fn>(std::move(fn));
+
+	std::lock_guard lock(hook_mutex);
+	hook = std::move(new_hook);
+}
+
+uint64_t rpx_data_bytes(const rpx::rpx& elf) {
+	uint64_t bytes = 0;
+	for (const auto& section : elf.sections) bytes += section.data.size();
+	return bytes;
+}
+
+stage_timer::~stage_timer() {
+	std::shared_ptr<const rpx::instrumentation_fn> current;
+	{
+		std::lock_guard lock(hook_mutex);
+		current = hook;
+	}
+	if (!current) return;
+
+	event.nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now() - start).count();
+	(*current)(event);
+}
+
+#endif
@@ -0,0 +1,54 @@
+// Copyright (C) 2020 Ash Logan <ash@heyquark.com>
+// Licensed under the terms of the GNU GPL, version 3
+// http://www.gnu.org/licenses/gpl-3.0.txt
+
+#pragma once
+
+#include "rpx.hpp"
+
+//helpers for reporting stage_events. with WIIURPX_INSTRUMENTATION off these
+//all expand to nothing (or just the expression they wrap).
+#ifdef WIIURPX_INSTRUMENTATION
+
+#include <chrono>
+#include <cstdint>
+
+//times a scope, reporting it on the way out if anyone's listening
+class stage_timer {
+public:
+	stage_timer(rpx::stage stage, size_t section) :
+		event { stage, section, 0, 0, 0, 0 },
+		start(std::chrono::steady_clock::now()) {}
+	~stage_timer();
+
+	stage_timer(const stage_timer&) = delete;
+	stage_timer& operator=(const stage_timer&) = delete;
+
+	rpx::stage_event event;
+	std::chrono::steady_clock::time_point start;
+};
+
+//total size of every section's data
+uint64_t rpx_data_bytes(const rpx::rpx& elf);
+
+//starts timing the rest of the scope as rpx::stage::which for section
+#define RPX_TIMER(name, which, section) stage_timer name(::rpx::stage::which, section)
+//sets how many bytes went in and came out
+#define RPX_TIMER_BYTES_IN(name, in) name.event.bytes_in = (in)
+#define RPX_TIMER_BYTES_OUT(name, out) name.event.bytes_out = (out)
+//runs expr, counting the time it takes as crc time
+#define RPX_TIMER_CRC(name, expr) do { \
+	auto crc_start = std::chrono::steady_clock::now(); \
+	expr; \
+	name.event.crc_nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>( \
+		std::chrono::steady_clock::now() - crc_start).count(); \
+} while (0)
+
+#else
+
+#define RPX_TIMER(name, which, section)
+#define RPX_TIMER_BYTES_IN(name, in)
+#define RPX_TIMER_BYTES_OUT(name, out)
+#define RPX_TIMER_CRC(name, expr) expr
+
+#endif
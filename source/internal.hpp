@@ -0,0 +1,56 @@
+// Copyright (C) 2020 Ash Logan <ash@heyquark.com>
+// Licensed under the terms of the GNU GPL, version 3
+// http://www.gnu.org/licenses/gpl-3.0.txt
+
+#pragma once
+
+#include "rpx.hpp"
+#include <vector>
+#include <functional>
+#include <iostream>
+
+//bits shared between the different readers. these live in wiiurpxlib.cpp.
+
+//checks the elf header looks like an rpx. prints a message if it doesn't.
+bool rpx_check_ehdr(const rpx::Elf32_Ehdr& ehdr);
+//fills in section_file_order from the section headers.
+void rpx_sort_file_order(rpx::rpx& elf);
+//same, when there's a header_table() around already.
+void rpx_sort_file_order(rpx::rpx& elf, const rpx::section_headers& headers);
+
+//the two halves of readrpx. reads the elf header and section headers and
+//sorts the file order, returning false if it's not an rpx...
+bool rpx_read_headers(rpx::rpx& elf, std::istream& is);
+//...then reads one section's data.
+void rpx_read_section(rpx::rpx& elf, size_t index, std::istream& is);
+
+//where the section header table ends.
+size_t rpx_headers_end(const rpx::rpx& elf);
+//writes the elf header and section headers, seeking to where they go.
+void rpx_write_headers(const rpx::rpx& elf, std::ostream& os);
+
+//inflates one section in place and works out its crc. returns false if it
+//didn't inflate.
+bool rpx_decompress_section(rpx::rpx& elf, size_t index, bool keep_original);
+//compresses every section like compress() does, but doesn't relink. calls
+//section_done (from whichever thread did it) as each section is finished.
+//returns false if any section failed to deflate.
+bool rpx_compress_sections(rpx::rpx& elf, const rpx::compress_options& options,
+	const std::function<void(size_t section)>& section_done);
+
+//whether compress() would try to deflate a section. some sections have to stay
+//uncompressed, and some already are.
+bool rpx_compressible(const rpx::Elf32_Shdr& shdr);
+//works out which deflate_settings apply to each section.
+std::vector<const rpx::deflate_settings*> rpx_section_settings(const rpx::rpx& elf, const rpx::compress_options& options);
+//whether compress() can put a section's original compressed bytes back
+//instead of deflating it again.
+bool rpx_reusable(const rpx::rpx::Section& section);
+//the block size compress() splits a section into (see
+//compress_options::block_threshold), or 0 if it does the whole section at once.
+size_t rpx_split_block_size(const rpx::rpx::Section& section, const rpx::compress_options& options);
+//the two bytes zlib would start a stream with for these settings.
+void rpx_zlib_header(const rpx::deflate_settings& settings, uint8_t header[2]);
+//reads the nul terminated string at offset in a string table, or an empty
+//string if it's out of bounds.
+std::string_view rpx_string(std::span<const uint8_t> strings, size_t offset);
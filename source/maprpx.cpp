@@ -0,0 +1,145 @@
+// Copyright (C) 2020 Ash Logan <ash@heyquark.com>
+// Licensed under the terms of the GNU GPL, version 3
+// http://www.gnu.org/licenses/gpl-3.0.txt
+
+#include "rpx.hpp"
+
+#include <cstdio>
+#include <cstdint>
+#include <string.h>
+#include <memory>
+#include <span>
+#include "internal.hpp"
+#include "instrumentation.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+using namespace rpx;
+
+namespace {
+
+//a read-only view of a whole file. sections hold a shared_ptr to this to keep
+//the mapping alive for as long as they borrow from it.
+class file_mapping {
+public:
+	file_mapping(const file_mapping&) = delete;
+	file_mapping& operator=(const file_mapping&) = delete;
+
+	static std::shared_ptr<file_mapping> open(const std::filesystem::path& path) {
+		auto map = std::shared_ptr<file_mapping>(new file_mapping);
+#ifdef _WIN32
+		HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+			nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE) return nullptr;
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+			CloseHandle(file);
+			return nullptr;
+		}
+
+		HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		CloseHandle(file);
+		if (!mapping) return nullptr;
+
+		void* base = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		CloseHandle(mapping);
+		if (!base) return nullptr;
+
+		map->bytes = std::span((const uint8_t*)base, (size_t)size.QuadPart);
+#else
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) return nullptr;
+
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size == 0) {
+			close(fd);
+			return nullptr;
+		}
+
+		void* base = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (base == MAP_FAILED) return nullptr;
+
+		map->bytes = std::span((const uint8_t*)base, (size_t)st.st_size);
+#endif
+		return map;
+	}
+
+	~file_mapping() {
+		if (bytes.empty()) return;
+#ifdef _WIN32
+		UnmapViewOfFile(bytes.data());
+#else
+		munmap((void*)bytes.data(), bytes.size());
+#endif
+	}
+
+	std::span<const uint8_t> bytes;
+
+private:
+	file_mapping() = default;
+};
+
+}
+
+std::optional<rpx::rpx> rpx::maprpx(const std::filesystem::path& path) {
+	RPX_TIMER(timer, maprpx, stage_event::whole_stage);
+	auto map = file_mapping::open(path);
+	if (!map) {
+		printf("couldn't map %s!\n", path.string().c_str());
+		return std::nullopt;
+	}
+	auto file = map->bytes;
+
+	rpx elf;
+	if (file.size() < sizeof(elf.ehdr)) {
+		printf("file too small!\n");
+		return std::nullopt;
+	}
+	memcpy(&elf.ehdr, file.data(), sizeof(elf.ehdr));
+	if (!rpx_check_ehdr(elf.ehdr)) return std::nullopt;
+
+	//make sure the section header table is actually in the file
+	size_t shoff = elf.ehdr.e_shoff.value();
+	size_t shentsize = elf.ehdr.e_shentsize.value();
+	size_t shnum = elf.ehdr.e_shnum.value();
+	if (shentsize < sizeof(Elf32_Shdr) || shoff + shnum * shentsize > file.size()) {
+		printf("section headers out of bounds!\n");
+		return std::nullopt;
+	}
+
+	elf.sections.resize(shnum);
+	section_headers headers;
+	headers.resize(shnum);
+	for (size_t i = 0; i < shnum; i++) {
+		auto& section = elf.sections[i];
+		memcpy(&section.hdr, file.data() + shoff + i * shentsize, sizeof(section.hdr));
+		headers.set(i, section.hdr);
+
+		size_t offset = headers.sh_offset[i];
+		size_t size = headers.sh_size[i];
+		if (!offset) continue;
+		if (offset + size > file.size()) {
+			printf("section %zu out of bounds!\n", i);
+			return std::nullopt;
+		}
+
+		//no copy - just point into the mapping
+		section.data = section_data::borrow(file.subspan(offset, size), map);
+	}
+
+	rpx_sort_file_order(elf, headers);
+
+	RPX_TIMER_BYTES_IN(timer, file.size());
+	RPX_TIMER_BYTES_OUT(timer, rpx_data_bytes(elf));
+	return elf;
+}
@@ -0,0 +1,62 @@
+// Copyright (C) 2020 Ash Logan <ash@heyquark.com>
+// Licensed under the terms of the GNU GPL, version 3
+// http://www.gnu.org/licenses/gpl-3.0.txt
+
+#include "rpx.hpp"
+
+#include <bit>
+#include <algorithm>
+
+using namespace rpx;
+
+//fnv-1a - symbol names are short and this is plenty for them
+static uint32_t hash_name(std::string_view name) {
+	uint32_t hash = 2166136261u;
+	for (char c : name) {
+		hash ^= (uint8_t)c;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+void name_table::reserve(size_t wanted) {
+	//kept at most half full, so probes stay short
+	size_t slot_count = std::bit_ceil(std::max<size_t>(wanted * 2, 16));
+	if (slot_count > slots.size()) rehash(slot_count);
+}
+
+void name_table::rehash(size_t slot_count) {
+	auto old = std::move(slots);
+	slots.assign(slot_count, {});
+	size_t mask = slot_count - 1;
+	for (const auto& s : old) {
+		if (s.index == npos) continue;
+		size_t i = s.hash & mask;
+		while (slots[i].index != npos) i = (i + 1) & mask;
+		slots[i] = s;
+	}
+}
+
+void name_table::insert(std::string_view name, uint32_t index) {
+	if ((count + 1) * 2 > slots.size()) reserve(count + 1);
+
+	uint32_t hash = hash_name(name);
+	size_t mask = slots.size() - 1;
+	size_t i = hash & mask;
+	for (; slots[i].index != npos; i = (i + 1) & mask) {
+		if (slots[i].hash == hash && slots[i].name == name) return;
+	}
+	slots[i] = { name, hash, index };
+	count++;
+}
+
+uint32_t name_table::find(std::string_view name) const {
+	if (slots.empty()) return npos;
+
+	uint32_t hash = hash_name(name);
+	size_t mask = slots.size() - 1;
+	for (size_t i = hash & mask; slots[i].index != npos; i = (i + 1) & mask) {
+		if (slots[i].hash == hash && slots[i].name == name) return slots[i].index;
+	}
+	return npos;
+}
@@ -0,0 +1,40 @@
+// Copyright (C) 2020 Ash Logan <ash@heyquark.com>
+// Licensed under the terms of the GNU GPL, version 3
+// http://www.gnu.org/licenses/gpl-3.0.txt
+
+#include "parallel.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+void run_parallel(size_t count, const std::function<void(size_t)>& job,
+	unsigned int threads, const rpx::parallel_for_fn& parallel_for) {
+	if (count == 0) return;
+	if (parallel_for) {
+		parallel_for(count, job);
+		return;
+	}
+
+	if (threads == 0) threads = std::max(std::thread::hardware_concurrency(), 1u);
+	threads = (unsigned int)std::min<size_t>(threads, count);
+	if (threads == 1) {
+		for (size_t i = 0; i < count; i++) job(i);
+		return;
+	}
+
+	//jobs are handed out in order, but they're all independent, so it doesn't
+	//matter who finishes first
+	std::atomic<size_t> next = 0;
+	auto worker = [&]() {
+		for (size_t i = next++; i < count; i = next++) job(i);
+	};
+
+	std::vector<std::thread> pool;
+	pool.reserve(threads - 1);
+	for (unsigned int i = 1; i < threads; i++) pool.emplace_back(worker);
+	//the calling thread pitches in too
+	worker();
+	for (auto& thread : pool) thread.join();
+}
@@ -0,0 +1,14 @@
+// Copyright (C) 2020 Ash Logan <ash@heyquark.com>
+// Licensed under the terms of the GNU GPL, version 3
+// http://www.gnu.org/licenses/gpl-3.0.txt
+
+#pragma once
+
+#include "rpx.hpp"
+#include <functional>
+
+//runs job(0) .. job(count - 1) using the caller's parallel_for if there is
+//one, otherwise on up to `threads` threads (0 = one per hardware thread).
+//returns once every job is done.
+void run_parallel(size_t count, const std::function<void(size_t)>& job,
+	unsigned int threads, const rpx::parallel_for_fn& parallel_for);
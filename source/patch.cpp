@@ -0,0 +1,538 @@
+// Copyright (C) 2020 Ash Logan <ash@heyquark.com>
+// Licensed under the terms of the GNU GPL, version 3
+// http://www.gnu.org/licenses/gpl-3.0.txt
+
+//diff() and patch(). a patch is "RPXP", the size of the body, then the body as
+//a zlib stream - same as a compressed section. the body is the new file's elf
+//header, then for each section its header, its crc32 field, the crc32 of its
+//bytes (to check the result against), and the size of its op followed by the
+//op itself - one of the ones below. numbers are LEB128 varints unless they're
+//part of a header.
+
+#include "rpx.hpp"
+
+#include <cstdio>
+#include <cstdint>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include "internal.hpp"
+#include "parallel.hpp"
+#include "backend.hpp"
+
+using namespace rpx;
+
+namespace {
+
+const char patch_magic[4] = { 'R', 'P', 'X', 'P' };
+
+enum patch_op : uint8_t {
+	//no data (sh_offset is 0)
+	op_none,
+	//the bytes of an old section, as they are. then: old section index
+	op_same,
+	//the bytes, stored whole. then: size, bytes
+	op_literal,
+	//the uncompressed bytes, as runs copied from an old section's uncompressed
+	//bytes with literals in between - deflated again afterwards if it was
+	//compressed. then: old section index, whether to deflate (and the four
+	//deflate_settings if so), uncompressed size, runs (see encode_delta)
+	op_delta,
+};
+
+void put_varint(std::vector<uint8_t>& out, uint64_t value) {
+	while (value >= 0x80) {
+		out.push_back((uint8_t)(value | 0x80));
+		value >>= 7;
+	}
+	out.push_back((uint8_t)value);
+}
+//for signed numbers - small either way round gets a small varint
+void put_svarint(std::vector<uint8_t>& out, int64_t value) {
+	put_varint(out, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+}
+void put_bytes(std::vector<uint8_t>& out, const void* data, size_t len) {
+	out.insert(out.end(), (const uint8_t*)data, (const uint8_t*)data + len);
+}
+
+//reads a patch body front to back. anything running off the end sets ok to
+//false and returns zeroes, so callers can check once at the end.
+struct patch_reader {
+	std::span<const uint8_t> data;
+	size_t pos = 0;
+	bool ok = true;
+
+	uint64_t varint() {
+		uint64_t value = 0;
+		for (int shift = 0; shift < 64; shift += 7) {
+			if (pos >= data.size()) break;
+			uint8_t b = data[pos++];
+			value |= (uint64_t)(b & 0x7F) << shift;
+			if (!(b & 0x80)) return value;
+		}
+		ok = false;
+		return 0;
+	}
+	int64_t svarint() {
+		uint64_t value = varint();
+		return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+	}
+	std::span<const uint8_t> bytes(size_t len) {
+		if (len > data.size() - pos) {
+			ok = false;
+			return {};
+		}
+		auto span = data.subspan(pos, len);
+		pos += len;
+		return span;
+	}
+	template <typename T>
+	T read() {
+		T value {};
+		auto span = bytes(sizeof(T));
+		if (ok) memcpy(&value, span.data(), sizeof(T));
+		return value;
+	}
+};
+
+//a section's uncompressed bytes, inflating a copy if need be
+struct contents {
+	std::vector<uint8_t> inflated;
+	std::span<const uint8_t> bytes;
+	bool ok = true;
+};
+contents uncompressed(const rpx::rpx::Section& section) {
+	contents c;
+	auto data = section.data.view();
+	if (!(section.hdr.sh_flags & SHF_RPL_ZLIB)) {
+		c.bytes = data;
+		return c;
+	}
+	c.inflated.resize(uncompressed_size(section));
+	c.ok = data.size() >= sizeof(uint32_t) &&
+		backend::inflate(data.subspan(sizeof(uint32_t)), c.inflated);
+	c.bytes = c.inflated;
+	return c;
+}
+
+//every section's name. section_name() needs .shstrtab decompressed, and both
+//rpxs are const, so this inflates a copy if it has to.
+struct section_names {
+	contents shstrtab;
+	std::vector<std::string_view> names;
+
+	section_names(const rpx::rpx& elf) : names(elf.sections.size()) {
+		size_t shstrndx = elf.ehdr.e_shstrndx.value();
+		if (shstrndx >= elf.sections.size()) return;
+		shstrtab = uncompressed(elf.sections[shstrndx]);
+		if (!shstrtab.ok) return;
+		for (size_t i = 0; i < elf.sections.size(); i++) {
+			names[i] = rpx_string(shstrtab.bytes, elf.sections[i].hdr.sh_name.value());
+		}
+	}
+};
+
+//the rsync trick - hash every block_size block of the old section, then slide
+//a window over the new one looking for them. a rolling hash means each step is
+//a couple of multiplies instead of hashing the whole window again.
+class block_matcher {
+public:
+	static constexpr uint32_t npos = UINT32_MAX;
+
+	block_matcher(std::span<const uint8_t> old_data, size_t block_size) :
+		old_data(old_data), block_size(block_size) {
+		for (size_t i = 1; i < block_size; i++) top_power *= multiplier;
+
+		size_t block_count = old_data.size() / block_size;
+		size_t bucket_count = 1;
+		while (bucket_count < block_count * 2) bucket_count <<= 1;
+		mask = bucket_count - 1;
+		heads.assign(bucket_count, npos);
+		next.resize(block_count);
+		hashes.resize(block_count);
+
+		//backwards, so each chain has the earliest block first
+		for (size_t b = block_count; b-- > 0;) {
+			uint32_t h = hash(old_data.data() + b * block_size);
+			hashes[b] = h;
+			next[b] = heads[h & mask];
+			heads[h & mask] = (uint32_t)b;
+		}
+	}
+
+	uint32_t hash(const uint8_t* p) const {
+		uint32_t h = 0;
+		for (size_t i = 0; i < block_size; i++) h = h * multiplier + p[i];
+		return h;
+	}
+	//slides the window along a byte - out is the byte leaving it, in the one
+	//coming in
+	uint32_t roll(uint32_t h, uint8_t out, uint8_t in) const {
+		return (h - out * top_power) * multiplier + in;
+	}
+
+	//an old block holding the same bytes as p (which has hash h), or npos
+	uint32_t find(uint32_t h, const uint8_t* p) const {
+		if (heads.empty()) return npos;
+		//long chains are all the same bytes anyway (zeroes, padding), so
+		//don't go too far down them
+		size_t tries = 0;
+		for (uint32_t b = heads[h & mask]; b != npos && tries < 16; b = next[b], tries++) {
+			if (hashes[b] == h && memcmp(old_data.data() + (size_t)b * block_size, p, block_size) == 0) {
+				return (uint32_t)(b * block_size);
+			}
+		}
+		return npos;
+	}
+
+private:
+	static constexpr uint32_t multiplier = 0x01000193;
+
+	std::span<const uint8_t> old_data;
+	size_t block_size;
+	uint32_t top_power = 1;
+	size_t mask = 0;
+	std::vector<uint32_t> heads;
+	std::vector<uint32_t> next;
+	std::vector<uint32_t> hashes;
+};
+
+//new_data as runs copied from old_data with literals in between. each run is
+//the literal's size and bytes, then (unless that reached the end) the copy's
+//size and where it's from - relative to where it'd be if the old and new
+//data were still lined up after the literal, which is usually 0.
+void encode_delta(std::span<const uint8_t> old_data, std::span<const uint8_t> new_data,
+	size_t block_size, std::vector<uint8_t>& out) {
+	size_t literal_start = 0;
+	size_t expected = 0;
+	auto emit = [&](size_t literal_end, size_t copy_from, size_t copy_len) {
+		put_varint(out, literal_end - literal_start);
+		put_bytes(out, new_data.data() + literal_start, literal_end - literal_start);
+		if (!copy_len) return;
+		size_t lined_up = expected + (literal_end - literal_start);
+		put_varint(out, copy_len);
+		put_svarint(out, (int64_t)copy_from - (int64_t)lined_up);
+		expected = copy_from + copy_len;
+		literal_start = literal_end + copy_len;
+	};
+
+	if (new_data.size() >= block_size && old_data.size() >= block_size) {
+		block_matcher matcher(old_data, block_size);
+		size_t pos = 0;
+		uint32_t h = matcher.hash(new_data.data());
+		while (true) {
+			const uint8_t* p = new_data.data() + pos;
+
+			//still lined up with the old data (only a few bytes changed), or
+			//a block from somewhere else
+			size_t lined_up = expected + (pos - literal_start);
+			size_t from = block_matcher::npos;
+			if (lined_up + block_size <= old_data.size() &&
+				memcmp(old_data.data() + lined_up, p, block_size) == 0) {
+				from = lined_up;
+			} else {
+				from = matcher.find(h, p);
+			}
+
+			if (from != block_matcher::npos) {
+				//stretch the match as far as it goes both ways
+				size_t back = 0;
+				while (pos - back > literal_start && from - back > 0 &&
+					new_data[pos - back - 1] == old_data[from - back - 1]) back++;
+				size_t len = block_size;
+				while (pos + len < new_data.size() && from + len < old_data.size() &&
+					new_data[pos + len] == old_data[from + len]) len++;
+
+				emit(pos - back, from - back, len + back);
+				pos += len;
+				if (pos + block_size > new_data.size()) break;
+				h = matcher.hash(new_data.data() + pos);
+				continue;
+			}
+
+			if (pos + block_size >= new_data.size()) break;
+			h = matcher.roll(h, p[0], p[block_size]);
+			pos++;
+		}
+	}
+	emit(new_data.size(), 0, 0);
+}
+
+//the other way round - rebuilds size bytes into out. out grows as the runs
+//are read rather than being made size bytes up front, so a broken size can't
+//allocate any more than the runs themselves actually add up to.
+bool decode_delta(std::span<const uint8_t> old_data, patch_reader& reader, uint64_t size, std::vector<uint8_t>& out) {
+	out.clear();
+	out.reserve((size_t)std::min<uint64_t>(size, old_data.size() + (reader.data.size() - reader.pos)));
+	size_t expected = 0;
+	while (true) {
+		size_t literal_len = reader.varint();
+		if (!reader.ok || literal_len > size - out.size()) return false;
+		auto literal = reader.bytes(literal_len);
+		if (!reader.ok) return false;
+		out.insert(out.end(), literal.begin(), literal.end());
+		expected += literal_len;
+		if (out.size() == size) return true;
+
+		size_t copy_len = reader.varint();
+		int64_t from = (int64_t)expected + reader.svarint();
+		if (!reader.ok || !copy_len || copy_len > size - out.size()) return false;
+		if (from < 0 || (uint64_t)from > old_data.size() || copy_len > old_data.size() - from) return false;
+		out.insert(out.end(), old_data.begin() + from, old_data.begin() + from + copy_len);
+		expected = from + copy_len;
+	}
+}
+
+//the most uncompressed bytes a section could hold, going by its size in the
+//file - deflate can't do better than about 1032:1. a quick sanity check on
+//the size a patch asks for.
+uint64_t max_contents_size(const Elf32_Shdr& hdr, bool deflated) {
+	uint64_t size = hdr.sh_size.value();
+	return deflated ? size * 1032 : size;
+}
+
+void put_settings(std::vector<uint8_t>& out, const deflate_settings& settings) {
+	put_svarint(out, settings.level);
+	put_svarint(out, settings.strategy);
+	put_svarint(out, settings.mem_level);
+	put_svarint(out, settings.window_bits);
+}
+deflate_settings read_settings(patch_reader& reader) {
+	deflate_settings settings;
+	settings.level = (int)reader.svarint();
+	settings.strategy = (int)reader.svarint();
+	settings.mem_level = (int)reader.svarint();
+	settings.window_bits = (int)reader.svarint();
+	return settings;
+}
+
+//uncompressed_sz and a zlib stream, like compress() makes - or nothing if it
+//didn't deflate
+std::vector<uint8_t> deflate_section(std::span<const uint8_t> data, const deflate_settings& settings) {
+	std::vector<uint8_t> out(sizeof(uint32_t) + backend::deflate_bound(data.size(), settings));
+	be2_val<uint32_t> uncompressed_sz = (uint32_t)data.size();
+	memcpy(out.data(), &uncompressed_sz, sizeof(uncompressed_sz));
+
+	size_t compressed_sz = backend::deflate(data, std::span(out).subspan(sizeof(uncompressed_sz)), settings);
+	if (!compressed_sz) return {};
+	out.resize(sizeof(uncompressed_sz) + compressed_sz);
+	return out;
+}
+
+//the op for one new section
+void diff_section(const rpx::rpx& from, const rpx::rpx& to, size_t index, size_t old_index,
+	const deflate_settings& settings, const diff_options& options, std::vector<uint8_t>& out) {
+	const auto& section = to.sections[index];
+	auto data = section.data.view();
+	if (!section.hdr.sh_offset) {
+		out.push_back(op_none);
+		return;
+	}
+	auto literal = [&] {
+		out.push_back(op_literal);
+		put_varint(out, data.size());
+		put_bytes(out, data.data(), data.size());
+	};
+	if (old_index >= from.sections.size()) return literal();
+
+	const auto& old_section = from.sections[old_index];
+	auto old_data = old_section.data.view();
+	if (old_data.size() == data.size() && memcmp(old_data.data(), data.data(), data.size()) == 0) {
+		out.push_back(op_same);
+		put_varint(out, old_index);
+		return;
+	}
+
+	//changed - but most of it's probably still in there somewhere, once
+	//both are inflated
+	auto old_contents = uncompressed(old_section);
+	auto new_contents = uncompressed(section);
+	if (!old_contents.ok || !new_contents.ok) return literal();
+
+	//a compressed section can only be rebuilt if deflating it again gives the
+	//exact same bytes back
+	bool deflate = section.hdr.sh_flags & SHF_RPL_ZLIB;
+	if (deflate) {
+		auto redeflated = deflate_section(new_contents.bytes, settings);
+		if (redeflated.size() != data.size() || memcmp(redeflated.data(), data.data(), data.size()) != 0) {
+			return literal();
+		}
+	}
+
+	//patch() won't take a size the header says is impossible
+	if (new_contents.bytes.size() > max_contents_size(section.hdr, deflate)) return literal();
+
+	std::vector<uint8_t> delta;
+	put_varint(delta, old_index);
+	delta.push_back(deflate);
+	if (deflate) put_settings(delta, settings);
+	put_varint(delta, new_contents.bytes.size());
+	encode_delta(old_contents.bytes, new_contents.bytes, std::max<size_t>(options.block_size, 1), delta);
+
+	//it's all getting deflated at the end anyway, so this is only a rough
+	//guess at which is smaller
+	if (delta.size() >= data.size()) return literal();
+	out.push_back(op_delta);
+	put_bytes(out, delta.data(), delta.size());
+}
+
+}
+
+std::vector<uint8_t> rpx::diff(const rpx& from, const rpx& to, const diff_options& options,
+	const compress_options& compress) {
+	//line new sections up with old ones by name, or by index if they don't
+	//have one
+	section_names from_names(from), to_names(to);
+	name_table old_by_name;
+	old_by_name.reserve(from.sections.size());
+	for (size_t i = 0; i < from.sections.size(); i++) {
+		if (!from_names.names[i].empty()) old_by_name.insert(from_names.names[i], (uint32_t)i);
+	}
+
+	std::vector<std::vector<uint8_t>> section_ops(to.sections.size());
+	run_parallel(to.sections.size(), [&](size_t i) {
+		auto name = to_names.names[i];
+		size_t old_index = name.empty() ? i : old_by_name.find(name);
+		if (old_index == name_table::npos) old_index = from.sections.size();
+
+		const deflate_settings* settings = &compress.settings;
+		auto override = compress.section_settings.find(name);
+		if (override != compress.section_settings.end()) settings = &override->second;
+
+		diff_section(from, to, i, old_index, *settings, options, section_ops[i]);
+	}, options.threads, options.parallel_for);
+
+	std::vector<uint8_t> body;
+	put_bytes(body, &to.ehdr, sizeof(to.ehdr));
+	put_varint(body, to.sections.size());
+	for (size_t i = 0; i < to.sections.size(); i++) {
+		const auto& section = to.sections[i];
+		be2_val<uint32_t> crcs[] = { section.crc32, ::rpx::crc32(0, section.data.view()) };
+		put_bytes(body, &section.hdr, sizeof(section.hdr));
+		put_bytes(body, crcs, sizeof(crcs));
+		put_varint(body, section_ops[i].size());
+		put_bytes(body, section_ops[i].data(), section_ops[i].size());
+		section_ops[i] = {};
+	}
+
+	deflate_settings patch_settings { .level = 9 };
+	std::vector<uint8_t> out(sizeof(patch_magic) + sizeof(uint32_t) +
+		backend::deflate_bound(body.size(), patch_settings));
+	memcpy(out.data(), patch_magic, sizeof(patch_magic));
+	be2_val<uint32_t> body_sz = (uint32_t)body.size();
+	memcpy(out.data() + sizeof(patch_magic), &body_sz, sizeof(body_sz));
+
+	size_t header_sz = sizeof(patch_magic) + sizeof(body_sz);
+	size_t compressed_sz = backend::deflate(body, std::span(out).subspan(header_sz), patch_settings);
+	out.resize(header_sz + compressed_sz);
+	return out;
+}
+
+std::optional<rpx::rpx> rpx::patch(const rpx& from, std::span<const uint8_t> delta, const patch_options& options) {
+	be2_val<uint32_t> body_sz;
+	size_t header_sz = sizeof(patch_magic) + sizeof(body_sz);
+	if (delta.size() < header_sz || memcmp(delta.data(), patch_magic, sizeof(patch_magic)) != 0) {
+		printf("WARN: not a patch!\n");
+		return std::nullopt;
+	}
+	memcpy(&body_sz, delta.data() + sizeof(patch_magic), sizeof(body_sz));
+	if (body_sz > (delta.size() - header_sz) * 1032) {
+		printf("WARN: patch is corrupt!\n");
+		return std::nullopt;
+	}
+	std::vector<uint8_t> body(body_sz);
+	if (!backend::inflate(delta.subspan(header_sz), body)) {
+		printf("WARN: patch is corrupt!\n");
+		return std::nullopt;
+	}
+
+	//headers first, and where each section's op is - then the ops can all go
+	//at once
+	patch_reader reader { body };
+	rpx elf;
+	elf.ehdr = reader.read<Elf32_Ehdr>();
+	size_t count = reader.varint();
+	if (!reader.ok || count > body.size()) {
+		printf("WARN: patch is corrupt!\n");
+		return std::nullopt;
+	}
+	elf.sections.resize(count);
+	std::vector<uint32_t> want_crcs(count);
+	std::vector<patch_reader> ops(count);
+	for (size_t i = 0; i < count && reader.ok; i++) {
+		auto& section = elf.sections[i];
+		section.hdr = reader.read<Elf32_Shdr>();
+		section.crc32 = reader.read<be2_val<uint32_t>>();
+		want_crcs[i] = reader.read<be2_val<uint32_t>>();
+		ops[i] = { reader.bytes(reader.varint()) };
+	}
+	if (!reader.ok || reader.pos != body.size()) {
+		printf("WARN: patch is corrupt!\n");
+		return std::nullopt;
+	}
+
+	std::atomic<size_t> failed = 0;
+	run_parallel(count, [&](size_t i) {
+		auto& section = elf.sections[i];
+		auto& op_reader = ops[i];
+		auto fail = [&](const char* why) {
+			printf("WARN: section %zu: %s\n", i, why);
+			failed++;
+		};
+		auto old_section = [&]() -> const rpx::Section* {
+			size_t old_index = op_reader.varint();
+			if (old_index >= from.sections.size()) return nullptr;
+			return &from.sections[old_index];
+		};
+
+		switch (op_reader.read<patch_op>()) {
+			case op_none: return;
+			case op_same: {
+				auto old = old_section();
+				if (!old) return fail("patch refers to a section that isn't there!");
+				section.data = old->data;
+				break;
+			}
+			case op_literal: {
+				auto bytes = op_reader.bytes(op_reader.varint());
+				if (!op_reader.ok) return fail("patch is corrupt!");
+				section.data = std::vector<uint8_t>(bytes.begin(), bytes.end());
+				break;
+			}
+			case op_delta: {
+				auto old = old_section();
+				if (!old) return fail("patch refers to a section that isn't there!");
+				bool deflate = op_reader.read<uint8_t>();
+				deflate_settings settings;
+				if (deflate) settings = read_settings(op_reader);
+				uint64_t size = op_reader.varint();
+				if (!op_reader.ok || size > max_contents_size(section.hdr, deflate)) return fail("patch is corrupt!");
+				auto old_contents = uncompressed(*old);
+				if (!old_contents.ok) return fail("old section failed to decompress!");
+				std::vector<uint8_t> data;
+				if (!decode_delta(old_contents.bytes, op_reader, size, data)) return fail("patch is corrupt!");
+
+				if (deflate) {
+					data = deflate_section(data, settings);
+					if (data.empty()) return fail("failed to compress!");
+				}
+				section.data = std::move(data);
+				break;
+			}
+			default: return fail("patch has an op this version doesn't know!");
+		}
+		section.data.mark_unmodified();
+
+		//catches patching the wrong file, or a backend that deflates
+		//differently to the one that made the patch
+		if (::rpx::crc32(0, section.data.view()) != want_crcs[i]) {
+			return fail("doesn't match the patched file - wrong original?");
+		}
+	}, options.threads, options.parallel_for);
+	if (failed) return std::nullopt;
+
+	//the headers came along too, offsets and all, so there's no need to
+	//relink - writerpx will give back exactly the file the patch was made from
+	rpx_sort_file_order(elf);
+	return elf;
+}
@@ -0,0 +1,188 @@
+// Copyright (C) 2020 Ash Logan <ash@heyquark.com>
+// Licensed under the terms of the GNU GPL, version 3
+// http://www.gnu.org/licenses/gpl-3.0.txt
+
+#include "rpx.hpp"
+
+#include <cstdio>
+#include <cstdint>
+#include <string.h>
+#include <algorithm>
+#include "internal.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+using namespace rpx;
+
+namespace {
+
+//sections whose starts are closer together than this get their uncompressed
+//sizes in one read, rather than one each
+const uint64_t coalesce_gap = 64 * 1024;
+
+//positioned reads from a file, so there's no seeking between them
+class file_reader {
+public:
+	file_reader(const file_reader&) = delete;
+	file_reader& operator=(const file_reader&) = delete;
+
+	file_reader(const std::filesystem::path& path) {
+#ifdef _WIN32
+		file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+			nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr);
+		LARGE_INTEGER li;
+		if (file != INVALID_HANDLE_VALUE && GetFileSizeEx(file, &li)) size = (uint64_t)li.QuadPart;
+#else
+		fd = ::open(path.c_str(), O_RDONLY);
+		struct stat st;
+		if (fd >= 0 && fstat(fd, &st) == 0) size = (uint64_t)st.st_size;
+#endif
+	}
+	~file_reader() {
+#ifdef _WIN32
+		if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+		if (fd >= 0) close(fd);
+#endif
+	}
+
+	bool ok() const {
+#ifdef _WIN32
+		return file != INVALID_HANDLE_VALUE;
+#else
+		return fd >= 0;
+#endif
+	}
+
+	//reads all of out from offset, or fails
+	bool read_at(uint64_t offset, std::span<uint8_t> out) const {
+		while (!out.empty()) {
+#ifdef _WIN32
+			OVERLAPPED ov {};
+			ov.Offset = (DWORD)offset;
+			ov.OffsetHigh = (DWORD)(offset >> 32);
+			DWORD len = (DWORD)std::min<size_t>(out.size(), 0x40000000);
+			DWORD got = 0;
+			if (!ReadFile(file, out.data(), len, &got, &ov) || got == 0) return false;
+#else
+			ssize_t got = pread(fd, out.data(), out.size(), (off_t)offset);
+			if (got <= 0) return false;
+#endif
+			offset += got;
+			out = out.subspan(got);
+		}
+		return true;
+	}
+
+	uint64_t size = 0;
+
+private:
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+#else
+	int fd = -1;
+#endif
+};
+
+}
+
+std::optional<rpx_probe> rpx::probe(const std::filesystem::path& path) {
+	file_reader file(path);
+	if (!file.ok()) {
+		printf("couldn't open %s!\n", path.string().c_str());
+		return std::nullopt;
+	}
+
+	rpx_probe result;
+	result.file_size = file.size;
+	if (!file.read_at(0, std::span((uint8_t*)&result.ehdr, sizeof(result.ehdr)))) {
+		printf("file too small!\n");
+		return std::nullopt;
+	}
+	if (!rpx_check_ehdr(result.ehdr)) return std::nullopt;
+
+	//the whole section header table in one go
+	uint64_t shoff = result.ehdr.e_shoff.value();
+	size_t shentsize = result.ehdr.e_shentsize.value();
+	size_t shnum = result.ehdr.e_shnum.value();
+	if (shentsize < sizeof(Elf32_Shdr) || shoff + shnum * shentsize > file.size) {
+		printf("section headers out of bounds!\n");
+		return std::nullopt;
+	}
+	std::vector<uint8_t> table(shnum * shentsize);
+	if (!file.read_at(shoff, table)) {
+		printf("couldn't read section headers!\n");
+		return std::nullopt;
+	}
+
+	//squeeze out any padding so they're one array for from_be
+	std::vector<Elf32_Shdr> shdrs(shnum);
+	if (shentsize == sizeof(Elf32_Shdr)) {
+		memcpy(shdrs.data(), table.data(), table.size());
+	} else {
+		for (size_t i = 0; i < shnum; i++) memcpy(&shdrs[i], table.data() + i * shentsize, sizeof(Elf32_Shdr));
+	}
+	std::vector<native::Elf32_Shdr> native_shdrs(shnum);
+	from_be(shdrs, native_shdrs);
+
+	result.sections.resize(shnum);
+	std::vector<size_t> zlib_sections;
+	for (size_t i = 0; i < shnum; i++) {
+		auto& section = result.sections[i];
+		section.hdr = native_shdrs[i];
+		section.uncompressed_size = section.hdr.sh_size;
+		if (!section.hdr.sh_offset) continue;
+
+		if ((uint64_t)section.hdr.sh_offset + section.hdr.sh_size > file.size) {
+			printf("section %zu out of bounds!\n", i);
+			return std::nullopt;
+		}
+		if (section.hdr.sh_flags & SHF_RPL_ZLIB) {
+			if (section.hdr.sh_size < sizeof(uint32_t)) {
+				printf("section %zu is too small to be compressed!\n", i);
+				return std::nullopt;
+			}
+			zlib_sections.push_back(i);
+		}
+	}
+
+	//the uncompressed sizes are the first 4 bytes of each zlib section. little
+	//sections (.rela.*, .symtab...) tend to be packed close together, so those
+	//get read a run at a time.
+	std::sort(zlib_sections.begin(), zlib_sections.end(), [&](size_t a, size_t b) {
+		return result.sections[a].hdr.sh_offset < result.sections[b].hdr.sh_offset;
+	});
+	std::vector<uint8_t> run;
+	for (size_t first = 0; first < zlib_sections.size();) {
+		uint64_t start = result.sections[zlib_sections[first]].hdr.sh_offset;
+		uint64_t end = start + sizeof(uint32_t);
+		size_t last = first + 1;
+		for (; last < zlib_sections.size(); last++) {
+			uint64_t next = result.sections[zlib_sections[last]].hdr.sh_offset;
+			if (next > end && next - end > coalesce_gap) break;
+			end = std::max<uint64_t>(end, next + sizeof(uint32_t));
+		}
+
+		run.resize(end - start);
+		if (!file.read_at(start, run)) {
+			printf("couldn't read section %zu!\n", zlib_sections[first]);
+			return std::nullopt;
+		}
+		for (size_t z = first; z < last; z++) {
+			auto& section = result.sections[zlib_sections[z]];
+			be2_val<uint32_t> uncompressed_sz;
+			memcpy(&uncompressed_sz, run.data() + (section.hdr.sh_offset - start), sizeof(uncompressed_sz));
+			section.uncompressed_size = uncompressed_sz;
+		}
+		first = last;
+	}
+
+	return result;
+}
@@ -0,0 +1,285 @@
+// Copyright (C) 2020 Ash Logan <ash@heyquark.com>
+// Licensed under the terms of the GNU GPL, version 3
+// http://www.gnu.org/licenses/gpl-3.0.txt
+
+#include "rpx.hpp"
+
+#include <cstdio>
+#include <cstdint>
+#include <string.h>
+#include <array>
+#include <atomic>
+#include <algorithm>
+#include "parallel.hpp"
+
+using namespace rpx;
+
+namespace {
+
+//what actually gets done to the section data. lots of relocation types come
+//down to the same write, so they're grouped by this.
+enum reloc_op : uint8_t {
+	op_write32,
+	op_write16,
+	//the same write, but the value has to fit in a signed 16 bits
+	op_write16_signed,
+	op_write16_hi,
+	op_write16_ha,
+	//the low 26 bits of an instruction, minus the bottom two
+	op_branch24,
+	//the low 16 bits of an instruction, minus the bottom two
+	op_branch14,
+	op_count,
+	op_none = op_count,
+	op_unsupported,
+};
+
+struct reloc_type {
+	reloc_op op;
+	bool relative;
+};
+
+constexpr reloc_type lookup_type(uint32_t type) {
+	switch (type) {
+		case R_PPC_NONE:         return { op_none, false };
+		case R_PPC_ADDR32:       return { op_write32, false };
+		case R_PPC_ADDR24:       return { op_branch24, false };
+		case R_PPC_ADDR16:       return { op_write16_signed, false };
+		case R_PPC_ADDR16_LO:    return { op_write16, false };
+		case R_PPC_ADDR16_HI:    return { op_write16_hi, false };
+		case R_PPC_ADDR16_HA:    return { op_write16_ha, false };
+		case R_PPC_ADDR14:       return { op_branch14, false };
+		case R_PPC_REL24:        return { op_branch24, true };
+		case R_PPC_REL14:        return { op_branch14, true };
+		case R_PPC_REL32:        return { op_write32, true };
+		case R_PPC_GHS_REL16_HA: return { op_write16_ha, true };
+		case R_PPC_GHS_REL16_HI: return { op_write16_hi, true };
+		case R_PPC_GHS_REL16_LO: return { op_write16, true };
+		default:                 return { op_unsupported, false };
+	}
+}
+
+//every type, so the hot loop doesn't have to go through the switch
+constexpr std::array<reloc_type, 256> type_table = [] {
+	std::array<reloc_type, 256> table {};
+	for (uint32_t i = 0; i < table.size(); i++) table[i] = lookup_type(i);
+	return table;
+}();
+
+//one relocation, ready to go - bounds checked, with the final value worked out
+struct prepared_reloc {
+	uint32_t offset;
+	uint32_t value;
+};
+
+inline uint32_t load32(const uint8_t* p) {
+	be2_val<uint32_t> v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+inline void store32(uint8_t* p, uint32_t value) {
+	be2_val<uint32_t> v = value;
+	memcpy(p, &v, sizeof(v));
+}
+inline void store16(uint8_t* p, uint16_t value) {
+	be2_val<uint16_t> v = value;
+	memcpy(p, &v, sizeof(v));
+}
+
+//the batched loops - one kind of write over a whole run of relocations
+void apply_op(reloc_op op, std::span<const prepared_reloc> relocs, uint8_t* data) {
+	switch (op) {
+		case op_write32:
+			for (const auto& r : relocs) store32(data + r.offset, r.value);
+			break;
+		case op_write16:
+		case op_write16_signed:
+			for (const auto& r : relocs) store16(data + r.offset, (uint16_t)r.value);
+			break;
+		case op_write16_hi:
+			for (const auto& r : relocs) store16(data + r.offset, (uint16_t)(r.value >> 16));
+			break;
+		case op_write16_ha:
+			for (const auto& r : relocs) store16(data + r.offset, (uint16_t)((r.value + 0x8000) >> 16));
+			break;
+		case op_branch24:
+			for (const auto& r : relocs) {
+				uint32_t insn = load32(data + r.offset);
+				store32(data + r.offset, (insn & ~0x03FFFFFCu) | (r.value & 0x03FFFFFCu));
+			}
+			break;
+		case op_branch14:
+			for (const auto& r : relocs) {
+				uint32_t insn = load32(data + r.offset);
+				store32(data + r.offset, (insn & ~0x0000FFFCu) | (r.value & 0x0000FFFCu));
+			}
+			break;
+		default: break;
+	}
+}
+
+size_t op_width(reloc_op op) {
+	return op == op_write16 || op == op_write16_signed || op == op_write16_hi || op == op_write16_ha ? 2 : 4;
+}
+
+//whether a branch target (or a plain 16 bit value) fits in the instruction.
+//it's sign extended, so this is the same whether it's relative or not.
+bool in_range(reloc_op op, uint32_t value) {
+	int32_t offset = (int32_t)value;
+	if (op == op_write16_signed) return offset >= -0x8000 && offset < 0x8000;
+	if (op == op_branch24) return offset >= -0x2000000 && offset < 0x2000000;
+	if (op == op_branch14) return offset >= -0x8000 && offset < 0x8000;
+	return true;
+}
+
+//relocations are done in batches this big. sorting a whole section's worth by
+//op would mean going over the section once per op - a batch's worth of
+//section is still in cache for the next op.
+const size_t batch_size = 2048;
+
+//one target section's worth of relocating
+struct target_state {
+	uint8_t* data;
+	size_t size;
+	//where the section is, and where it's going
+	uint32_t old_base;
+	uint32_t new_base;
+	std::span<const uint32_t> deltas;
+
+	size_t unsupported = 0;
+	size_t out_of_range = 0;
+	std::array<prepared_reloc, batch_size> sorted;
+};
+
+//sorts a batch by op (a counting sort, so each op's relocations stay in order),
+//working out the values and checking them on the way, then runs each op's
+//loop over them
+void apply_batch(target_state& state, std::span<const native::Elf32_Rela> relas, std::span<const native::Elf32_Sym> syms) {
+	std::array<size_t, op_count + 1> op_starts {};
+	for (const auto& rela : relas) {
+		auto op = type_table[rela.r_info & 0xFF].op;
+		if (op < op_count) op_starts[op + 1]++;
+	}
+	for (size_t o = 1; o <= op_count; o++) op_starts[o] += op_starts[o - 1];
+
+	auto op_ends = op_starts;
+	for (const auto& rela : relas) {
+		auto type = type_table[rela.r_info & 0xFF];
+		if (type.op == op_none) continue;
+		uint32_t sym = rela.r_info >> 8;
+		uint32_t offset = rela.r_offset - state.old_base;
+		if (type.op == op_unsupported || sym >= syms.size()) {
+			state.unsupported++;
+			continue;
+		}
+		if (offset > state.size || state.size - offset < op_width(type.op)) {
+			state.out_of_range++;
+			continue;
+		}
+
+		uint32_t shndx = syms[sym].st_shndx;
+		uint32_t value = syms[sym].st_value + rela.r_addend;
+		if (shndx < state.deltas.size()) value += state.deltas[shndx];
+		if (type.relative) value -= state.new_base + offset;
+		if (!in_range(type.op, value)) {
+			state.out_of_range++;
+			continue;
+		}
+		state.sorted[op_ends[type.op]++] = { offset, value };
+	}
+
+	for (size_t o = 0; o < op_count; o++) {
+		apply_op((reloc_op)o, std::span(state.sorted.data() + op_starts[o], state.sorted.data() + op_ends[o]), state.data);
+	}
+}
+
+}
+
+bool rpx::relocate(rpx& elf, const relocate_options& options) {
+	size_t count = elf.sections.size();
+	auto load_address = [&](size_t section) -> uint32_t {
+		if (section < options.section_addresses.size()) return options.section_addresses[section];
+		return elf.sections[section].hdr.sh_addr;
+	};
+
+	//work out which relocation sections go with each target, and everything
+	//that needs inflating
+	std::vector<std::vector<size_t>> target_relas(count);
+	std::vector<bool> needed(count);
+	for (size_t i = 0; i < count; i++) {
+		const auto& hdr = elf.sections[i].hdr;
+		if (hdr.sh_type != SHT_RELA) continue;
+		size_t target = hdr.sh_info.value();
+		size_t symtab = hdr.sh_link.value();
+		if (target >= count || symtab >= count || !elf.sections[target].hdr.sh_offset ||
+			elf.sections[symtab].hdr.sh_type != SHT_SYMTAB) {
+			printf("WARN: relocation section %zu has a bad target or symbol table!\n", i);
+			continue;
+		}
+		target_relas[target].push_back(i);
+		needed[i] = needed[target] = needed[symtab] = true;
+	}
+
+	std::vector<size_t> to_inflate;
+	for (size_t i = 0; i < count; i++) {
+		if (needed[i]) to_inflate.push_back(i);
+	}
+	run_parallel(to_inflate.size(), [&](size_t i) {
+		section_contents(elf, to_inflate[i]);
+	}, options.threads, options.parallel_for);
+
+	//how far each section is moving. undefined symbols don't move, and neither
+	//do absolute ones (or anything else past SHN_LORESERVE).
+	std::vector<uint32_t> deltas(std::min<size_t>(count, SHN_LORESERVE));
+	for (size_t i = 1; i < deltas.size(); i++) deltas[i] = load_address(i) - elf.sections[i].hdr.sh_addr;
+
+	//every symbol table that's used, swapped once up front since several
+	//targets can share them
+	std::vector<std::vector<native::Elf32_Sym>> symbols(count);
+	for (size_t i = 0; i < count; i++) {
+		if (!needed[i] || elf.sections[i].hdr.sh_type != SHT_SYMTAB) continue;
+		auto symtab = elf.sections[i].data.view();
+		symbols[i].resize(symtab.size() / sizeof(Elf32_Sym));
+		from_be(std::span((const Elf32_Sym*)symtab.data(), symbols[i].size()), symbols[i]);
+	}
+
+	std::atomic<size_t> failed = 0;
+	std::vector<size_t> targets;
+	for (size_t i = 0; i < count; i++) {
+		if (!target_relas[i].empty()) targets.push_back(i);
+	}
+
+	//targets are independent of each other, so they can go in parallel
+	run_parallel(targets.size(), [&](size_t t) {
+		size_t target = targets[t];
+		auto& section = elf.sections[target];
+		target_state state {
+			.data = section.data.data(),
+			.size = section.data.size(),
+			.old_base = section.hdr.sh_addr,
+			.new_base = load_address(target),
+			.deltas = deltas,
+		};
+
+		std::vector<native::Elf32_Rela> relas;
+		for (size_t rela_index : target_relas[target]) {
+			auto rela_data = elf.sections[rela_index].data.view();
+			relas.resize(rela_data.size() / sizeof(Elf32_Rela));
+			from_be(std::span((const Elf32_Rela*)rela_data.data(), relas.size()), relas);
+
+			const auto& syms = symbols[elf.sections[rela_index].hdr.sh_link.value()];
+			for (size_t start = 0; start < relas.size(); start += batch_size) {
+				size_t len = std::min(batch_size, relas.size() - start);
+				apply_batch(state, std::span(relas).subspan(start, len), syms);
+			}
+		}
+
+		if (state.unsupported || state.out_of_range) {
+			printf("WARN: section %zu: skipped %zu unsupported and %zu out of range relocations!\n",
+				target, state.unsupported, state.out_of_range);
+			failed++;
+		}
+	}, options.threads, options.parallel_for);
+
+	return failed == 0;
+}
@@ -0,0 +1,226 @@
+// Copyright (C) 2020 Ash Logan <ash@heyquark.com>
+// Licensed under the terms of the GNU GPL, version 3
+// http://www.gnu.org/licenses/gpl-3.0.txt
+
+#include "rpx.hpp"
+
+#include <cstdio>
+#include <cstdint>
+#include <string.h>
+#include <fstream>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include "sha256.hpp"
+#include "backend.hpp"
+
+using namespace rpx;
+namespace fs = std::filesystem;
+
+namespace {
+
+//at the start of every entry, so a torn or stray file is never mistaken for one
+struct entry_header {
+	char magic[4];
+	be2_val<uint32_t> size;
+	be2_val<uint32_t> crc32;
+};
+const char entry_magic[4] = { 'R', 'P', 'X', 'Z' };
+
+//temporary files older than this were left behind by a crash
+const auto stale_temp_age = std::chrono::hours(1);
+
+bool is_hex(std::string_view str) {
+	return std::all_of(str.begin(), str.end(), [](char c) {
+		return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f');
+	});
+}
+
+//the directory can be shared with anything, so only files named the way put()
+//names them are ever touched - <2 hex>/<64 hex>, and while they're being
+//written <2 hex>/.<64 hex>.<16 hex>.tmp
+bool is_entry_dir(const fs::path& path) {
+	auto name = path.filename().string();
+	return name.size() == 2 && is_hex(name);
+}
+bool is_entry(const fs::path& path) {
+	auto name = path.filename().string();
+	return name.size() == 64 && is_hex(name) && name.starts_with(path.parent_path().filename().string());
+}
+bool is_temp(const fs::path& path) {
+	auto name = path.filename().string();
+	if (name.size() != 1 + 64 + 1 + 16 + 4 || name[0] != '.' || name[65] != '.' || !name.ends_with(".tmp")) return false;
+	return is_hex(std::string_view(name).substr(1, 64)) && is_hex(std::string_view(name).substr(66, 16));
+}
+
+//an entry's magic is there, so it really is one of ours
+bool has_entry_magic(const fs::path& path) {
+	char magic[sizeof(entry_magic)];
+	std::ifstream is(path, std::ios::binary);
+	return is.read(magic, sizeof(magic)) && memcmp(magic, entry_magic, sizeof(magic)) == 0;
+}
+
+std::string hex(std::span<const uint8_t> bytes) {
+	static const char digits[] = "0123456789abcdef";
+	std::string str;
+	str.reserve(bytes.size() * 2);
+	for (auto b : bytes) {
+		str += digits[b >> 4];
+		str += digits[b & 0xF];
+	}
+	return str;
+}
+
+}
+
+section_cache::section_cache(fs::path dir, uint64_t max_bytes) :
+	dir(std::move(dir)), max_bytes(max_bytes), untrimmed_bytes(max_bytes) {
+	std::error_code ec;
+	fs::create_directories(this->dir, ec);
+	if (ec) printf("WARN: couldn't create cache directory %s!\n", this->dir.string().c_str());
+}
+
+std::string section_cache::key(std::span<const uint8_t> uncompressed, const deflate_settings& settings) const {
+	//different libraries (or settings) make different streams for the same
+	//input, so they're part of the key too
+	be2_val<int32_t> params[] = { settings.level, settings.strategy, settings.mem_level, settings.window_bits };
+	std::string_view backend_name = backend::name();
+
+	sha256 hash;
+	hash.update(std::span((const uint8_t*)backend_name.data(), backend_name.size() + 1));
+	hash.update(std::span((const uint8_t*)params, sizeof(params)));
+	hash.update(uncompressed);
+	return hex(hash.finish());
+}
+
+fs::path section_cache::entry_path(const std::string& key) const {
+	//spread entries over 256 directories, like git does
+	return dir / key.substr(0, 2) / key;
+}
+
+std::optional<std::vector<uint8_t>> section_cache::get(const std::string& key) const {
+	auto path = entry_path(key);
+	std::ifstream is(path, std::ios::binary);
+	if (!is) return std::nullopt;
+
+	entry_header header;
+	if (!is.read((char*)&header, sizeof(header))) return std::nullopt;
+	if (memcmp(header.magic, entry_magic, sizeof(entry_magic)) != 0) return std::nullopt;
+
+	//don't trust the size until the file's been seen to be that big
+	std::error_code ec;
+	auto file_size = fs::file_size(path, ec);
+	if (ec || file_size - sizeof(header) < header.size) {
+		printf("WARN: cache entry %s is truncated!\n", key.c_str());
+		return std::nullopt;
+	}
+
+	std::vector<uint8_t> compressed(header.size);
+	if (!is.read((char*)compressed.data(), compressed.size())) return std::nullopt;
+	if (::rpx::crc32(0, compressed) != header.crc32) {
+		printf("WARN: cache entry %s is corrupt!\n", key.c_str());
+		return std::nullopt;
+	}
+
+	//mark it as recently used. if it got trimmed in the meantime, no matter
+	fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+	return compressed;
+}
+
+void section_cache::put(const std::string& key, std::span<const uint8_t> compressed) const {
+	auto path = entry_path(key);
+	std::error_code ec;
+	fs::create_directories(path.parent_path(), ec);
+
+	//a name nobody else (thread or process) is going to pick
+	thread_local std::mt19937_64 rng(std::random_device{}());
+	uint64_t nonce = rng();
+	auto temp_path = path.parent_path() / ("." + key + "." +
+		hex(std::span((const uint8_t*)&nonce, sizeof(nonce))) + ".tmp");
+
+	entry_header header;
+	memcpy(header.magic, entry_magic, sizeof(entry_magic));
+	header.size = (uint32_t)compressed.size();
+	header.crc32 = ::rpx::crc32(0, compressed);
+	{
+		std::ofstream os(temp_path, std::ios::binary);
+		os.write((const char*)&header, sizeof(header));
+		os.write((const char*)compressed.data(), compressed.size());
+		if (!os) {
+			os.close();
+			fs::remove(temp_path, ec);
+			return;
+		}
+	}
+
+	//if someone else got there first, theirs is just as good
+	fs::rename(temp_path, path, ec);
+	if (ec) {
+		fs::remove(temp_path, ec);
+		return;
+	}
+	untrimmed_bytes += sizeof(header) + compressed.size();
+}
+
+void section_cache::trim() const {
+	struct entry {
+		fs::path path;
+		uint64_t size;
+		fs::file_time_type time;
+	};
+	untrimmed_bytes = 0;
+	std::vector<entry> entries;
+	uint64_t total = 0;
+	auto now = fs::file_time_type::clock::now();
+
+	//files can disappear out from under us at any point, so errors on one entry
+	//just skip it. entries are only ever in the <2 hex> directories, so
+	//nothing else gets looked in.
+	std::error_code ec, entry_ec;
+	for (auto it = fs::recursive_directory_iterator(dir, ec); !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+		if (it.depth() == 0) {
+			if (!it->is_directory(entry_ec) || !is_entry_dir(it->path())) it.disable_recursion_pending();
+			continue;
+		}
+		it.disable_recursion_pending();
+		if (!it->is_regular_file(entry_ec)) continue;
+		bool temp = is_temp(it->path());
+		if (!temp && !is_entry(it->path())) continue;
+		auto time = it->last_write_time(entry_ec);
+		if (entry_ec) continue;
+
+		if (temp) {
+			if (now - time > stale_temp_age) fs::remove(it->path(), entry_ec);
+			continue;
+		}
+
+		uint64_t size = it->file_size(entry_ec);
+		if (entry_ec || !has_entry_magic(it->path())) continue;
+		entries.push_back({ it->path(), size, time });
+		total += size;
+	}
+	if (total <= max_bytes) return;
+
+	//oldest first
+	std::sort(entries.begin(), entries.end(), [](const entry& a, const entry& b) {
+		return a.time < b.time;
+	});
+	for (const auto& e : entries) {
+		if (total <= max_bytes) break;
+		//another process may have beaten us to it - either way it's gone
+		fs::remove(e.path, entry_ec);
+		total -= e.size;
+	}
+}
+
+void section_cache::trim_if_due() const {
+	uint64_t due_at = std::max<uint64_t>(max_bytes / 16, 1);
+	//only one thread gets to do it
+	uint64_t added = untrimmed_bytes.load();
+	while (added >= due_at) {
+		if (untrimmed_bytes.compare_exchange_weak(added, 0)) {
+			trim();
+			return;
+		}
+	}
+}
@@ -0,0 +1,62 @@
+// Copyright (C) 2020 Ash Logan <ash@heyquark.com>
+// Licensed under the terms of the GNU GPL, version 3
+// http://www.gnu.org/licenses/gpl-3.0.txt
+
+#include "rpx.hpp"
+
+#include <cstdint>
+#include <algorithm>
+
+using namespace rpx;
+
+section_headers::section_headers(std::span<const Elf32_Shdr> headers) {
+	resize(headers.size());
+	for (size_t i = 0; i < headers.size(); i++) set(i, headers[i]);
+}
+
+void section_headers::resize(size_t count) {
+	for (auto* field : { &sh_name, &sh_type, &sh_flags, &sh_addr, &sh_offset, &sh_size,
+		&sh_link, &sh_info, &sh_addralign, &sh_entsize }) {
+		field->resize(count);
+	}
+}
+
+void section_headers::set(size_t index, const Elf32_Shdr& hdr) {
+	//straight from big endian into each array - a copy of the whole table to
+	//swap in bulk first costs more than it saves
+	sh_name[index] = hdr.sh_name;
+	sh_type[index] = hdr.sh_type;
+	sh_flags[index] = hdr.sh_flags;
+	sh_addr[index] = hdr.sh_addr;
+	sh_offset[index] = hdr.sh_offset;
+	sh_size[index] = hdr.sh_size;
+	sh_link[index] = hdr.sh_link;
+	sh_info[index] = hdr.sh_info;
+	sh_addralign[index] = hdr.sh_addralign;
+	sh_entsize[index] = hdr.sh_entsize;
+}
+
+std::vector<size_t> section_headers::file_order() const {
+	//offset and index packed into one key, so the sort is on plain uint64s
+	//and ties come out the same every time
+	std::vector<uint64_t> keys(size());
+	for (size_t i = 0; i < keys.size(); i++) keys[i] = (uint64_t)sh_offset[i] << 32 | i;
+	std::sort(keys.begin(), keys.end());
+
+	std::vector<size_t> order(keys.size());
+	for (size_t i = 0; i < order.size(); i++) order[i] = (uint32_t)keys[i];
+	return order;
+}
+
+size_t section_headers::find_type(uint32_t type, size_t start) const {
+	if (start >= size()) return npos;
+	auto it = std::find(sh_type.begin() + start, sh_type.end(), type);
+	return it == sh_type.end() ? npos : it - sh_type.begin();
+}
+
+section_headers rpx::header_table(const rpx& elf) {
+	section_headers headers;
+	headers.resize(elf.sections.size());
+	for (size_t i = 0; i < elf.sections.size(); i++) headers.set(i, elf.sections[i].hdr);
+	return headers;
+}
@@ -0,0 +1,29 @@
+// Copyright (C) 2020 Ash Logan <ash@heyquark.com>
+// Licensed under the terms of the GNU GPL, version 3
+// http://www.gnu.org/licenses/gpl-3.0.txt
+
+#pragma once
+
+#include <array>
+#include <span>
+#include <cstdint>
+#include <cstddef>
+
+//plain FIPS 180-4 sha256. only used to name section_cache entries, so it
+//doesn't need to be fast - it just needs to not collide.
+class sha256 {
+public:
+	void update(std::span<const uint8_t> data);
+	std::array<uint8_t, 32> finish();
+
+private:
+	void block(const uint8_t* p);
+
+	uint32_t h[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+		0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+	};
+	uint8_t buffer[64];
+	size_t buffered = 0;
+	uint64_t length = 0;
+};
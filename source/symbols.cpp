@@ -0,0 +1,99 @@
+// Copyright (C) 2020 Ash Logan <ash@heyquark.com>
+// Licensed under the terms of the GNU GPL, version 3
+// http://www.gnu.org/licenses/gpl-3.0.txt
+
+#include "rpx.hpp"
+
+#include <cstdio>
+#include <algorithm>
+#include "internal.hpp"
+
+using namespace rpx;
+
+symbol_index::symbol_index(std::vector<symbol> symbols) : entries(std::move(symbols)) {
+	std::stable_sort(entries.begin(), entries.end(), [](const symbol& a, const symbol& b) {
+		return a.value < b.value;
+	});
+
+	for (size_t i = 0; i < entries.size(); i++) {
+		const auto& sym = entries[i];
+		if (sym.shndx == SHN_UNDEF || sym.shndx >= SHN_LORESERVE) continue;
+		if (sym.type == STT_SECTION || sym.type == STT_FILE) continue;
+		addresses.push_back(sym.value);
+		address_entries.push_back((uint32_t)i);
+		uint64_t end = (uint64_t)sym.value + sym.size;
+		max_ends.push_back(max_ends.empty() ? end : std::max(max_ends.back(), end));
+	}
+
+	//the table keeps the first of any duplicates, so put globals in first
+	names.reserve(entries.size());
+	for (int pass = 0; pass < 2; pass++) {
+		for (size_t i = 0; i < entries.size(); i++) {
+			bool local = entries[i].binding == STB_LOCAL;
+			if (local == (pass == 0)) continue;
+			names.insert(entries[i].name, (uint32_t)i);
+		}
+	}
+}
+
+const symbol* symbol_index::find(std::string_view name) const {
+	auto i = names.find(name);
+	return i == name_table::npos ? nullptr : &entries[i];
+}
+
+const symbol* symbol_index::find_address(uint32_t addr) const {
+	//the last symbol starting at or before addr
+	auto it = std::upper_bound(addresses.begin(), addresses.end(), addr);
+	if (it == addresses.begin()) return nullptr;
+	size_t i = it - addresses.begin() - 1;
+	const auto& closest = entries[address_entries[i]];
+	if (!closest.size) return &closest;
+
+	//it might end before addr while something bigger that starts earlier
+	//doesn't - keep going back until nothing before here reaches addr
+	for (;; i--) {
+		if (max_ends[i] <= addr) return nullptr;
+		const auto& sym = entries[address_entries[i]];
+		if (sym.size && addr - sym.value < sym.size) return &sym;
+		if (i == 0) return nullptr;
+	}
+}
+
+symbol_index rpx::index_symbols(rpx& elf) {
+	std::vector<symbol> symbols;
+	std::vector<native::Elf32_Sym> syms;
+
+	for (size_t i = 0; i < elf.sections.size(); i++) {
+		if (elf.sections[i].hdr.sh_type != SHT_SYMTAB) continue;
+		size_t strtab_index = elf.sections[i].hdr.sh_link.value();
+		if (strtab_index >= elf.sections.size()) {
+			printf("WARN: symbol table %zu has no string table!\n", i);
+			continue;
+		}
+
+		auto symtab = section_contents(elf, i).view();
+		auto strtab = section_contents(elf, strtab_index).view();
+
+		//one bulk byteswap instead of going through be2_val for every field
+		syms.resize(symtab.size() / sizeof(Elf32_Sym));
+		from_be(std::span((const Elf32_Sym*)symtab.data(), syms.size()), syms);
+
+		symbols.reserve(symbols.size() + syms.size());
+		for (const auto& sym : syms) {
+			if (!sym.st_name) continue;
+			auto name = rpx_string(strtab, sym.st_name);
+			if (name.empty()) continue;
+
+			symbols.push_back({
+				.name = name,
+				.value = sym.st_value,
+				.size = sym.st_size,
+				.type = (uint8_t)(sym.st_info & 0xF),
+				.binding = (uint8_t)(sym.st_info >> 4),
+				.shndx = sym.st_shndx,
+			});
+		}
+	}
+
+	return symbol_index(std::move(symbols));
+}
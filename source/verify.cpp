@@ -0,0 +1,73 @@
+// Copyright (C) 2020 Ash Logan <ash@heyquark.com>
+// Licensed under the terms of the GNU GPL, version 3
+// http://www.gnu.org/licenses/gpl-3.0.txt
+
+#include "rpx.hpp"
+
+#include <cstdio>
+#include <cstdint>
+#include <string.h>
+#include <algorithm>
+#include <mutex>
+#include "parallel.hpp"
+#include "backend.hpp"
+
+using namespace rpx;
+using crc = be2_val<uint32_t>;
+
+//the crc of a section's uncompressed data, or nothing if it won't inflate
+static std::optional<uint32_t> section_crc(const rpx::rpx::Section& section) {
+	auto data = section.data.view();
+	if (!section.hdr.sh_offset) return 0;
+	if (!(section.hdr.sh_flags & SHF_RPL_ZLIB)) return ::rpx::crc32(0, data);
+
+	be2_val<uint32_t> uncompressed_sz;
+	if (data.size() < sizeof(uncompressed_sz)) return std::nullopt;
+	memcpy(&uncompressed_sz, data.data(), sizeof(uncompressed_sz));
+
+	//crc each piece while it's still in cache, rather than inflating it all
+	//and going back over it
+	uint32_t crc32 = 0;
+	bool ok = backend::inflate_stream(data.subspan(sizeof(uncompressed_sz)), uncompressed_sz,
+		[&](std::span<const uint8_t> chunk) {
+			crc32 = ::rpx::crc32(crc32, chunk);
+		}
+	);
+	if (!ok) return std::nullopt;
+	return crc32;
+}
+
+std::optional<std::vector<crc_mismatch>> rpx::verify_crcs(const rpx& elf, const verify_options& options) {
+	auto crc_section = std::find_if(elf.sections.begin(), elf.sections.end(), [](const rpx::Section& s) {
+		return s.hdr.sh_type == SHT_RPL_CRCS;
+	});
+	if (crc_section == elf.sections.end()) {
+		printf("WARN: no crc section to verify against!\n");
+		return std::nullopt;
+	}
+	size_t crc_index = crc_section - elf.sections.begin();
+
+	auto table = crc_section->data.view();
+	std::vector<uint32_t> expected(table.size() / sizeof(crc));
+	from_be(std::span((const crc*)table.data(), expected.size()), expected);
+
+	std::vector<crc_mismatch> mismatches;
+	std::mutex mismatches_mutex;
+	run_parallel(elf.sections.size(), [&](size_t i) {
+		//the table's own entry is always 0
+		if (i == crc_index) return;
+		uint32_t want = i < expected.size() ? expected[i] : 0;
+
+		auto actual = section_crc(elf.sections[i]);
+		if (actual && *actual == want) return;
+
+		std::lock_guard lock(mismatches_mutex);
+		mismatches.push_back({ i, want, actual });
+	}, options.threads, options.parallel_for);
+
+	//threads finish in any order
+	std::sort(mismatches.begin(), mismatches.end(), [](const crc_mismatch& a, const crc_mismatch& b) {
+		return a.section < b.section;
+	});
+	return mismatches;
+}
@@ -13,19 +13,23 @@
 #include <vector>
 #include <span>
 #include <algorithm>
-#include <numeric>
 #include <iterator>
-#include <zlib.h>
+#include <atomic>
 #include "util.hpp"
-#include "crc32.hpp"
-
-#define CHUNK 16384
-#define ZLIB_LEVEL 6
+#include "internal.hpp"
+#include "parallel.hpp"
+#include "backend.hpp"
+#include "adler32.hpp"
+#include "instrumentation.hpp"
 
 using namespace rpx;
 using crc = be2_val<uint32_t>;
 
-void rpx::writerpx(const rpx& elf, std::ostream& os) {
+size_t rpx_headers_end(const rpx::rpx& elf) {
+	return elf.ehdr.e_shoff.value() + elf.sections.size() * elf.ehdr.e_shentsize.value();
+}
+
+void rpx_write_headers(const rpx::rpx& elf, std::ostream& os) {
 	//write elf header out
 	os.write((char*)&elf.ehdr, sizeof(elf.ehdr));
 
@@ -37,12 +41,23 @@ void rpx::writerpx(const rpx& elf, std::ostream& os) {
 
 		if (shdr_pad) os.seekp(shdr_pad, std::ios_base::cur);
 	}
+}
+
+void rpx::writerpx(const rpx& elf, std::ostream& os) {
+	RPX_TIMER(timer, writerpx, stage_event::whole_stage);
+	RPX_TIMER_BYTES_IN(timer, rpx_data_bytes(elf));
+	RPX_TIMER_BYTES_OUT(timer, writerpxsize(elf));
+
+	rpx_write_headers(elf, os);
 
 	//these variables are a bit weird but it's optimisation I swear
 	uint32_t file_offset;
 	uint32_t size;
 	for (auto section_index : elf.section_file_order) {
 		const auto& section = elf.sections[section_index];
+		RPX_TIMER(section_timer, writerpx, section_index);
+		RPX_TIMER_BYTES_IN(section_timer, section.data.size());
+		RPX_TIMER_BYTES_OUT(section_timer, section.data.size());
 
 		file_offset = section.hdr.sh_offset.value();
 		os.seekp(file_offset);
@@ -50,17 +65,114 @@ void rpx::writerpx(const rpx& elf, std::ostream& os) {
 		os.write((const char*)section.data.data(), size);
 	}
 	file_offset += size;
+	//the section headers might be last, and padding inside them would
+	//clobber one
+	size_t end = std::max<size_t>(file_offset, rpx_headers_end(elf));
 	//if file length is not aligned to 0x40...
-	if (file_offset & (0x40 - 1)) {
+	if (end & (0x40 - 1)) {
 		//pad end of file
-		os.seekp(alignup(file_offset, 0x40) - 1);
+		os.seekp(alignup(end, 0x40) - 1);
 		os.put(0x00);
 	}
 }
 
+bool rpx_check_ehdr(const Elf32_Ehdr& ehdr) {
+	if (memcmp(ehdr.e_ident, "\x7f""ELF", 4) != 0) {
+		printf("e_ident bad!\n");
+		return false;
+	}
+	if (ehdr.e_type != 0xFE01) {
+		printf("e_type bad!\n");
+		return false;
+	}
+	return true;
+}
+
+void rpx_sort_file_order(rpx::rpx& elf) {
+	rpx_sort_file_order(elf, header_table(elf));
+}
+
+void rpx_sort_file_order(rpx::rpx& elf, const section_headers& headers) {
+	elf.section_file_order = headers.file_order();
+}
+
+bool rpx::writerpx(const rpx& elf, std::span<uint8_t> out) {
+	RPX_TIMER(timer, writerpx, stage_event::whole_stage);
+	auto size = writerpxsize(elf);
+	RPX_TIMER_BYTES_IN(timer, rpx_data_bytes(elf));
+	RPX_TIMER_BYTES_OUT(timer, size);
+	if (out.size() < size) {
+		printf("output buffer is %zx bytes - needs %zx!\n", out.size(), size);
+		return false;
+	}
+	//only the bit we're using - anything after that is the caller's business
+	out = out.first(size);
+
+	size_t shoff = elf.ehdr.e_shoff.value();
+	size_t shentsize = elf.ehdr.e_shentsize.value();
+
+	//everything gets written front to back, so we only need to zero the gaps
+	//between writes. relink always puts the section headers first, but if
+	//they're somewhere else just zero the lot up front.
+	size_t pos = 0;
+	for (auto section_index : elf.section_file_order) {
+		const auto& section = elf.sections[section_index];
+		if (section.data.empty()) continue;
+		if (section.hdr.sh_offset < shoff + elf.sections.size() * shentsize) {
+			memset(out.data(), 0, out.size());
+		}
+		break;
+	}
+	auto put = [&](size_t offset, const void* data, size_t len) {
+		if (offset > size || size - offset < len) return false;
+		if (offset > pos) memset(out.data() + pos, 0, offset - pos);
+		memcpy(out.data() + offset, data, len);
+		pos = std::max(pos, offset + len);
+		return true;
+	};
+
+	//write elf header out
+	if (!put(0, &elf.ehdr, sizeof(elf.ehdr))) {
+		printf("elf header doesn't fit!\n");
+		return false;
+	}
+
+	if (shentsize < sizeof(Elf32_Shdr)) {
+		printf("section headers are too small!\n");
+		return false;
+	}
+	for (size_t i = 0; i < elf.sections.size(); i++) {
+		if (!put(shoff + i * shentsize, &elf.sections[i].hdr, sizeof(elf.sections[i].hdr))) {
+			printf("section headers don't fit!\n");
+			return false;
+		}
+	}
+
+	for (auto section_index : elf.section_file_order) {
+		const auto& section = elf.sections[section_index];
+		if (section.data.empty()) continue;
+
+		auto offset = section.hdr.sh_offset.value();
+		if (!put(offset, section.data.data(), section.data.size())) {
+			printf("section %zu doesn't fit - forgot to relink?\n", section_index);
+			return false;
+		}
+	}
+
+	//pad end of file
+	if (size > pos) memset(out.data() + pos, 0, size - pos);
+
+	return true;
+}
+
 size_t rpx::writerpxsize(const rpx& rpx) {
-	auto& last_section = rpx.sections[rpx.section_file_order.back()];
-	size_t length = last_section.hdr.sh_offset.value() + last_section.hdr.sh_size.value();
+	//the section headers don't have to come first (a file that hasn't been
+	//relinked, say), so the end of the file is whichever is last
+	size_t length = std::max(sizeof(rpx.ehdr), rpx_headers_end(rpx));
+	if (!rpx.section_file_order.empty()) {
+		auto& last_section = rpx.sections[rpx.section_file_order.back()];
+		length = std::max<size_t>(length, last_section.hdr.sh_offset.value() + last_section.hdr.sh_size.value());
+	}
 
 	if (length & (0x40 - 1)) {
 		length = alignup(length, 0x40);
@@ -69,59 +181,80 @@ size_t rpx::writerpxsize(const rpx& rpx) {
 	return length;
 }
 
-std::optional<rpx::rpx> rpx::readrpx(std::istream& is) {
-	rpx elf;
+bool rpx_read_headers(rpx::rpx& elf, std::istream& is) {
 	is_read_advance(elf.ehdr, is);
-	if (memcmp(elf.ehdr.e_ident, "\x7f""ELF", 4) != 0) {
-		printf("e_ident bad!\n");
-		return std::nullopt;
-	}
-	if (elf.ehdr.e_type != 0xFE01) {
-		printf("e_type bad!\n");
-		return std::nullopt;
+	if (!rpx_check_ehdr(elf.ehdr)) return false;
+
+	size_t shnum = elf.ehdr.e_shnum.value();
+	size_t shentsize = elf.ehdr.e_shentsize.value();
+	if (shentsize < sizeof(Elf32_Shdr)) {
+		printf("section headers are too small!\n");
+		return false;
 	}
 
-	//allocate space for section headers
-	elf.sections.resize(elf.ehdr.e_shnum);
-	//get padding (if any) for section header entries
-	auto shdr_pad = elf.ehdr.e_shentsize - sizeof(elf.sections[0].hdr);
-	//seek to first section header
+	//the whole table in one read. if the entries are padded, pick the headers
+	//out afterwards
+	std::vector<Elf32_Shdr> headers(shnum);
 	is.seekg(elf.ehdr.e_shoff.value());
-	//go!
-	for (auto& section : elf.sections) {
-		//read in section header
-		is_read_advance(section.hdr, is);
-
-		//if the section headers are padded advance the stream past it
-		if (shdr_pad) is.seekg(shdr_pad, std::ios_base::cur);
+	if (shentsize == sizeof(Elf32_Shdr)) {
+		is.read((char*)headers.data(), shnum * shentsize);
+	} else {
+		std::vector<uint8_t> table(shnum * shentsize);
+		is.read((char*)table.data(), table.size());
+		for (size_t i = 0; i < shnum; i++) memcpy(&headers[i], table.data() + i * shentsize, sizeof(Elf32_Shdr));
+	}
+	if (!is) {
+		printf("couldn't read section headers!\n");
+		return false;
 	}
 
+	elf.sections.resize(shnum);
+	for (size_t i = 0; i < shnum; i++) elf.sections[i].hdr = headers[i];
+
 	//sort by file offset, so we always seek forwards and maintain file order
-	elf.section_file_order.resize(elf.sections.size());
-	std::iota(elf.section_file_order.begin(), elf.section_file_order.end(), 0);
-	std::sort(elf.section_file_order.begin(), elf.section_file_order.end(),
-		[=] (const auto& a, const auto& b) {
-			return elf.sections[a].hdr.sh_offset < elf.sections[b].hdr.sh_offset;
-		}
-	);
+	rpx_sort_file_order(elf, section_headers(headers));
+	return true;
+}
 
-	//read section data
-	for (auto& section_index : elf.section_file_order) {
-		auto& section = elf.sections[section_index];
-		auto& shdr = section.hdr;
-		if (!shdr.sh_offset) continue;
+void rpx_read_section(rpx::rpx& elf, size_t index, std::istream& is) {
+	auto& section = elf.sections[index];
+	auto& shdr = section.hdr;
+	if (!shdr.sh_offset) return;
+	RPX_TIMER(section_timer, readrpx, index);
 
-		is.seekg(shdr.sh_offset.value());
+	is.seekg(shdr.sh_offset.value());
 
-		//allocate and read the uncompressed data
-		section.data.resize(shdr.sh_size);
-		is.read((char*)section.data.data(), section.data.size());
+	//allocate and read the uncompressed data
+	section.data = section_data::allocate(shdr.sh_size, elf.arena);
+	is.read((char*)section.data.data(), section.data.size());
+	section.data.mark_unmodified();
+
+	RPX_TIMER_BYTES_IN(section_timer, section.data.size());
+	RPX_TIMER_BYTES_OUT(section_timer, section.data.size());
+}
+
+std::optional<rpx::rpx> rpx::readrpx(std::istream& is, std::shared_ptr<section_arena> arena) {
+	RPX_TIMER(timer, readrpx, stage_event::whole_stage);
+	rpx elf;
+	elf.arena = std::move(arena);
+	if (!rpx_read_headers(elf, is)) return std::nullopt;
+
+	//read section data
+	for (auto section_index : elf.section_file_order) {
+		rpx_read_section(elf, section_index, is);
+	}
+	if (!is) {
+		printf("couldn't read section data - file is truncated?\n");
+		return std::nullopt;
 	}
 
+	RPX_TIMER_BYTES_IN(timer, rpx_data_bytes(elf));
+	RPX_TIMER_BYTES_OUT(timer, rpx_data_bytes(elf));
 	return elf;
 }
 
 void rpx::relink(rpx& elf) {
+	RPX_TIMER(timer, relink, stage_event::whole_stage);
 	//some variables to keep track of the current file offset
 	auto data_start = elf.ehdr.e_shoff + elf.ehdr.e_shnum * elf.ehdr.e_shentsize;
 	auto file_offset = data_start;
@@ -130,31 +263,38 @@ void rpx::relink(rpx& elf) {
 	auto crc_section = std::find_if(elf.sections.begin(), elf.sections.end(), [](rpx::Section& s){
 		return s.hdr.sh_type == SHT_RPL_CRCS;
 	});
-	crc_section->crc32 = 0;
+	if (crc_section == elf.sections.end()) {
+		//nowhere to put them, but the layout still needs doing
+		printf("WARN: no crc section! Not updating crcs.\n");
+	} else {
+		crc_section->crc32 = 0;
+
+		//check if size wrong
+		if (crc_section->data.size() != elf.sections.size() * sizeof(crc)) {
+			printf("WARN: crc section is %x bytes - should be %x! Fixing.\n",
+				crc_section->data.size(),
+				elf.sections.size() * sizeof(crc)
+			);
+
+			crc_section->data.resize(elf.sections.size() * sizeof(crc));
+		}
 
-	//check if size wrong
-	if (crc_section->data.size() != elf.sections.size() * sizeof(crc)) {
-		printf("WARN: crc section is %x bytes - should be %x! Fixing.\n",
-			crc_section->data.size(),
-			elf.sections.size() * sizeof(crc)
+		//spans: keeping all the jank in one place since 2020
+		std::span<crc> crcs(
+			(crc*)crc_section->data.data(),
+			crc_section->data.size() / sizeof(crc)
 		);
 
-		crc_section->data.resize(elf.sections.size() * sizeof(crc));
+		std::vector<uint32_t> native_crcs(crcs.size());
+		for (size_t i = 0; i < native_crcs.size(); i++) native_crcs[i] = elf.sections[i].crc32;
+		to_be(native_crcs, crcs);
 	}
 
-	//spans: keeping all the jank in one place since 2020
-	std::span<crc> crcs(
-		(crc*)crc_section->data.data(),
-		crc_section->data.size() / sizeof(crc)
-	);
-
 	bool first_section = true;
 	for (auto section_index : elf.section_file_order) {
 		auto& section = elf.sections[section_index];
 		auto& shdr = section.hdr;
 
-		crcs[section_index] = section.crc32;
-
 		if (!shdr.sh_offset) continue;
 
 		shdr.sh_size = (uint32_t)section.data.size();
@@ -170,103 +310,404 @@ void rpx::relink(rpx& elf) {
 	}
 }
 
-void rpx::decompress(rpx& elf) {
-	//decompress sections
-	for (auto& section : elf.sections) {
-		auto& shdr = section.hdr;
-		if (!shdr.sh_offset) continue;
+bool rpx_compressible(const Elf32_Shdr& shdr) {
+	return !(shdr.sh_type == SHT_RPL_FILEINFO || shdr.sh_type == SHT_RPL_CRCS ||
+		shdr.sh_flags & SHF_RPL_ZLIB);
+}
+
+bool rpx_reusable(const rpx::rpx::Section& section) {
+	return !section.original.empty() && !section.data.modified() && rpx_compressible(section.hdr);
+}
 
-		if (shdr.sh_flags & SHF_RPL_ZLIB) {
-			//read in uncompressed size
-			be2_val<uint32_t> uncompressed_sz;
-			memcpy(&uncompressed_sz, section.data.data(), sizeof(uncompressed_sz));
-			//calc compressed size
+std::string_view rpx_string(std::span<const uint8_t> strings, size_t offset) {
+	if (offset >= strings.size()) return {};
+
+	//names are nul terminated, but don't trust that
+	auto str = std::string_view((const char*)strings.data() + offset, strings.size() - offset);
+	return str.substr(0, str.find('\0'));
+}
+
+std::vector<const deflate_settings*> rpx_section_settings(const rpx::rpx& elf, const compress_options& options) {
+	std::vector<const deflate_settings*> settings(elf.sections.size(), &options.settings);
+	if (!options.section_settings.empty()) {
+		for (size_t i = 0; i < elf.sections.size(); i++) {
+			auto override = options.section_settings.find(section_name(elf, i));
+			if (override != options.section_settings.end()) settings[i] = &override->second;
+		}
+	}
+	return settings;
+}
+
+bool rpx_decompress_section(rpx::rpx& elf, size_t index, bool keep_original) {
+	auto& section = elf.sections[index];
+	auto& shdr = section.hdr;
+	if (!shdr.sh_offset) return true;
+	RPX_TIMER(timer, decompress, index);
+	RPX_TIMER_BYTES_IN(timer, section.data.size());
+
+	if (shdr.sh_flags & SHF_RPL_ZLIB) {
+		//read in uncompressed size
+		be2_val<uint32_t> uncompressed_sz;
+		if (section.data.size() < sizeof(uncompressed_sz)) {
+			printf("WARN: compressed section is too small!\n");
+			return false;
+		}
+		auto compressed = std::move(section.data);
+		memcpy(&uncompressed_sz, compressed.view().data(), sizeof(uncompressed_sz));
+
+		auto uncompressed_data = section_data::allocate(uncompressed_sz, elf.arena);
+
+		//decompress! the rest of the section is one zlib stream. the crc is
+		//done on each piece as it comes out, while it's still in cache
+		uint32_t crc = 0;
+		bool inflated = backend::inflate(compressed.view().subspan(sizeof(uncompressed_sz)),
+			std::span(uncompressed_data.data(), uncompressed_data.size()),
+			[&](std::span<const uint8_t> piece) {
+				RPX_TIMER_CRC(timer, crc = rpx::crc32(crc, piece));
+			});
+		if (!inflated) printf("WARN: section failed to decompress!\n");
+
+		section.data = std::move(uncompressed_data);
+		section.data.mark_unmodified();
+		if (keep_original) section.original = std::move(compressed);
+
+		//we decompressed this section, so clear the flag
+		shdr.sh_flags &= ~SHF_RPL_ZLIB;
+		shdr.sh_size = (uint32_t)section.data.size();
 
-			z_stream zstream = { 0 };
-			inflateInit(&zstream);
+		//a broken stream stops partway, so it needs doing properly
+		if (inflated) section.crc32 = crc;
+		else RPX_TIMER_CRC(timer, section.crc32 = rpx::crc32(0, section.data.view()));
+		RPX_TIMER_BYTES_OUT(timer, section.data.size());
+		return inflated;
+	} else {
+		//compute crc
+		RPX_TIMER_CRC(timer, section.crc32 = rpx::crc32(0, section.data.view()));
+	}
+	RPX_TIMER_BYTES_OUT(timer, section.data.size());
+	return true;
+}
 
-			//pass to zlib
-			zstream.avail_in = section.data.size() - sizeof(uncompressed_sz);
-			zstream.next_in = (Bytef*)section.data.data() + sizeof(uncompressed_sz);
+//swaps a section's data for uncompressed_sz followed by a zlib stream, if
+//that's worthwhile. returns whether it was.
+static bool store_compressed(rpx::rpx& elf, size_t index, std::span<const uint8_t> stream) {
+	auto& section = elf.sections[index];
+	be2_val<uint32_t> uncompressed_sz = (uint32_t)section.data.size();
+
+	//not really sure how the original tool does this, but it sure does
+	size_t compressed_sz = sizeof(uncompressed_sz) + stream.size();
+	if (compressed_sz >= section.data.size()) return false;
+
+	auto compressed_data = section_data::allocate(compressed_sz, elf.arena);
+	memcpy(compressed_data.data(), &uncompressed_sz, sizeof(uncompressed_sz));
+	memcpy(compressed_data.data() + sizeof(uncompressed_sz), stream.data(), stream.size());
+	section.data = std::move(compressed_data);
+
+	//we compressed this section, so update the flag
+	section.hdr.sh_flags |= SHF_RPL_ZLIB;
+	section.hdr.sh_size = (uint32_t)section.data.size();
+	return true;
+}
 
-			std::vector<uint8_t> uncompressed_data;
-			uncompressed_data.resize(uncompressed_sz);
+//biggest deflate buffer compress_section holds on to between sections
+static const size_t max_scratch_size = 16 * 1024 * 1024;
+
+//works out the crc of one section and deflates it in place, if worthwhile.
+//returns false if deflating failed (rather than just not being worth it).
+static bool compress_section(rpx::rpx& elf, size_t index, const deflate_settings& settings,
+	const compress_options& options, std::atomic<bool>& cache_added) {
+	auto& section = elf.sections[index];
+	auto& shdr = section.hdr;
+	if (!shdr.sh_offset) return true;
+	RPX_TIMER(timer, compress, index);
+	RPX_TIMER_BYTES_IN(timer, section.data.size());
+	RPX_TIMER_BYTES_OUT(timer, section.data.size());
+
+	//nothing's changed since decompress, so neither has the crc
+	if (options.reuse_unmodified && rpx_reusable(section)) {
+		section.data = std::move(section.original);
+		section.original.clear();
 
-			//reset uncompressed chunk buffer
-			zstream.avail_out = uncompressed_data.size();
-			zstream.next_out = (Bytef*)uncompressed_data.data();
+		shdr.sh_flags |= SHF_RPL_ZLIB;
+		shdr.sh_size = (uint32_t)section.data.size();
+		RPX_TIMER_BYTES_OUT(timer, section.data.size());
+		return true;
+	}
+	//out of date now, or about to be
+	section.original.clear();
 
-			//decompress!
-			int zret = inflate(&zstream, Z_FINISH);
+	if (!rpx_compressible(shdr)) {
+		RPX_TIMER_CRC(timer, section.crc32 = rpx::crc32(0, section.data.view()));
+		return true;
+	}
 
-			inflateEnd(&zstream);
+	//maybe it's been done before
+	const section_cache* cache = nullptr;
+	std::string cache_key;
+	std::optional<std::vector<uint8_t>> cached;
+	if (options.cache && section.data.size() >= options.cache->min_section_size) {
+		cache = options.cache;
+		cache_key = cache->key(section.data.view(), settings);
+		cached = cache->get(cache_key);
+	}
 
-			section.data = std::move(uncompressed_data);
+	//the output doesn't have a size until it's done, so it goes here first.
+	//each thread keeps its own, so usually this doesn't allocate at all
+	thread_local std::vector<uint8_t> scratch;
+	std::span<const uint8_t> stream;
+	if (cached) {
+		stream = *cached;
+		RPX_TIMER_CRC(timer, section.crc32 = rpx::crc32(0, section.data.view()));
+	} else {
+		scratch.resize(backend::deflate_bound(section.data.size(), settings));
+
+		//given deflate_bound, this is guaranteed to succeed. the crc is done on
+		//each piece just before zlib gets it, so it's only read from memory once
+		uint32_t crc = 0;
+		size_t compressed_sz = backend::deflate(section.data.view(), scratch, settings,
+			[&](std::span<const uint8_t> piece) {
+				RPX_TIMER_CRC(timer, crc = rpx::crc32(crc, piece));
+			});
+		if (!compressed_sz) {
+			printf("WARN: section %zu failed to compress!\n", index);
+			RPX_TIMER_CRC(timer, section.crc32 = rpx::crc32(0, section.data.view()));
+			return false;
+		}
+		section.crc32 = crc;
 
-			//we decompressed this section, so clear the flag
-			shdr.sh_flags &= ~SHF_RPL_ZLIB;
-			shdr.sh_size = (uint32_t)section.data.size();
+		stream = std::span(scratch).first(compressed_sz);
+		if (cache) {
+			cache->put(cache_key, stream);
+			cache_added = true;
 		}
-		//compute crc
-		section.crc32 = crc32_rpx(
-			0,
-			section.data.cbegin(),
-			section.data.cend()
-		);
 	}
+	bool stored = store_compressed(elf, index, stream);
+
+	//don't keep a giant buffer around forever after one giant section
+	if (scratch.capacity() > max_scratch_size) scratch = {};
+
+	if (stored) {
+		RPX_TIMER_BYTES_OUT(timer, section.data.size());
+	}
+	return true;
+}
+
+bool rpx::decompress(rpx& elf, const decompress_options& options) {
+	RPX_TIMER(timer, decompress, stage_event::whole_stage);
+	RPX_TIMER_BYTES_IN(timer, rpx_data_bytes(elf));
+
+	//decompress sections - they're all independent of each other
+	std::atomic<bool> failed = false;
+	run_parallel(elf.sections.size(), [&](size_t i) {
+		if (!rpx_decompress_section(elf, i, options.keep_original)) failed = true;
+	}, options.threads, options.parallel_for);
+	RPX_TIMER_BYTES_OUT(timer, rpx_data_bytes(elf));
 
 	//relink elf to adjust file offsets
 	relink(elf);
+	return !failed;
 }
 
-void rpx::compress(rpx& elf) {
-	for (auto& section : elf.sections) {
-		auto& shdr = section.hdr;
-		if (!shdr.sh_offset) continue;
+namespace {
+
+//a section that's being deflated in blocks, pigz style
+struct split_section {
+	size_t index;
+	size_t block_size;
+	//raw deflate data for each block (empty if it failed), and the adler32
+	//and crc32 of its input
+	std::vector<std::vector<uint8_t>> blocks;
+	std::vector<uint32_t> adlers;
+	std::vector<uint32_t> crcs;
+};
+
+struct compress_job {
+	static constexpr size_t whole_section = (size_t)-1;
+
+	size_t section;
+	//which block of a split section, or whole_section
+	size_t block;
+	//index into the split sections, if block isn't whole_section
+	size_t split;
+};
 
-		//compute crc
-		section.crc32 = crc32_rpx(
-			0,
-			section.data.cbegin(),
-			section.data.cend()
-		);
+}
 
-		if (shdr.sh_type == SHT_RPL_FILEINFO || shdr.sh_type == SHT_RPL_CRCS ||
-			shdr.sh_flags & SHF_RPL_ZLIB) continue;
+void rpx_zlib_header(const deflate_settings& settings, uint8_t header[2]) {
+	int level = settings.level < 0 ? 6 : settings.level;
+	//Z_HUFFMAN_ONLY and up don't really have a level
+	int flevel = (settings.strategy >= 2 || level < 2) ? 0 : (level < 6) ? 1 : (level == 6) ? 2 : 3;
 
-		be2_val<uint32_t> uncompressed_sz = (uint32_t)section.data.size();
+	unsigned int bits = ((settings.window_bits - 8) << 4 | 8) << 8 | flevel << 6;
+	bits += 31 - bits % 31;
+	header[0] = bits >> 8;
+	header[1] = bits & 0xFF;
+}
 
-		z_stream zstream = { 0 };
-		deflateInit(&zstream, ZLIB_LEVEL);
+size_t rpx_split_block_size(const rpx::rpx::Section& section, const compress_options& options) {
+	bool split = options.block_threshold && backend::can_deflate_blocks() && section.hdr.sh_offset &&
+		rpx_compressible(section.hdr) && section.data.size() > options.block_threshold &&
+		!(options.reuse_unmodified && rpx_reusable(section));
+	return split ? std::max<size_t>(options.block_size, 1) : 0;
+}
 
-		//pass to zlib
-		zstream.avail_in = section.data.size();
-		zstream.next_in = (Bytef*)section.data.data();
+//sticks the blocks of a split section together into one zlib stream and
+//stores it, same as compress_section would have
+static bool join_split_section(rpx::rpx& elf, split_section& split,
+	const deflate_settings& settings, const compress_options& options, std::atomic<bool>& cache_added) {
+	auto& section = elf.sections[split.index];
+	//shouldn't happen, but the normal way still works
+	bool failed = std::any_of(split.blocks.begin(), split.blocks.end(), [](const auto& block) {
+		return block.empty();
+	});
+	if (failed) return compress_section(elf, split.index, settings, options, cache_added);
+	RPX_TIMER(timer, compress, split.index);
+	RPX_TIMER_BYTES_IN(timer, section.data.size());
+	RPX_TIMER_BYTES_OUT(timer, section.data.size());
+
+	section.original.clear();
+
+	size_t compressed_sz = 0;
+	for (const auto& block : split.blocks) compressed_sz += block.size();
+
+	//zlib header, blocks, adler32
+	std::vector<uint8_t> compressed_data(2);
+	compressed_data.reserve(compressed_data.size() + compressed_sz + sizeof(uint32_t));
+	rpx_zlib_header(settings, compressed_data.data());
+
+	//both checksums were done block by block, as each one was deflated
+	auto data_size = section.data.size();
+	uint32_t adler = 1;
+	uint32_t crc = 0;
+	for (size_t b = 0; b < split.blocks.size(); b++) {
+		auto& block = split.blocks[b];
+		compressed_data.insert(compressed_data.end(), block.begin(), block.end());
+		block = {};
+
+		size_t len = std::min(split.block_size, data_size - b * split.block_size);
+		adler = adler32_combine(adler, split.adlers[b], len);
+		crc = crc32_combine(crc, split.crcs[b], len);
+	}
+	section.crc32 = crc;
+	be2_val<uint32_t> adler_be = adler;
+	compressed_data.insert(compressed_data.end(), (uint8_t*)&adler_be, (uint8_t*)&adler_be + sizeof(adler_be));
 
-		std::vector<uint8_t> compressed_data;
-		compressed_data.resize(deflateBound(&zstream, zstream.avail_in) + sizeof(uncompressed_sz));
+	if (store_compressed(elf, split.index, compressed_data)) {
+		RPX_TIMER_BYTES_OUT(timer, section.data.size());
+	}
+	return true;
+}
 
-		zstream.avail_out = compressed_data.size() - sizeof(uncompressed_sz);
-		zstream.next_out = (Bytef*)compressed_data.data() + sizeof(uncompressed_sz);
+bool rpx_compress_sections(rpx::rpx& elf, const compress_options& options,
+	const std::function<void(size_t section)>& section_done) {
+	//look up the settings for each section first - .shstrtab is about to get
+	//compressed along with everything else
+	auto settings = rpx_section_settings(elf, options);
+
+	//sections over block_threshold get split into blocks, and each block is a
+	//job of its own alongside the other sections - so one huge .text can use
+	//every thread, not just one. they're queued up in file order, so the
+	//first sections in the file tend to be done first.
+	std::vector<split_section> splits;
+	std::vector<compress_job> jobs;
+	for (auto i : elf.section_file_order) {
+		const auto& section = elf.sections[i];
+		size_t block_size = rpx_split_block_size(section, options);
+		if (!block_size) {
+			jobs.push_back({ i, compress_job::whole_section, 0 });
+			continue;
+		}
 
-		//given deflateBound, this is guaranteed to succeed
-		int zret = deflate(&zstream, Z_FINISH);
+		size_t block_count = (section.data.size() + block_size - 1) / block_size;
+		for (size_t b = 0; b < block_count; b++) {
+			jobs.push_back({ i, b, splits.size() });
+		}
+		splits.push_back({ i, block_size, std::vector<std::vector<uint8_t>>(block_count),
+			std::vector<uint32_t>(block_count), std::vector<uint32_t>(block_count) });
+	}
+	//whoever finishes the last block of a split section joins it
+	std::vector<std::atomic<size_t>> blocks_left(splits.size());
+	for (size_t i = 0; i < splits.size(); i++) blocks_left[i] = splits[i].blocks.size();
+
+	std::atomic<bool> cache_added = false;
+	std::atomic<bool> failed = false;
+	run_parallel(jobs.size(), [&](size_t j) {
+		const auto& job = jobs[j];
+		if (job.block == compress_job::whole_section) {
+			if (!compress_section(elf, job.section, *settings[job.section], options, cache_added)) failed = true;
+			if (section_done) section_done(job.section);
+			return;
+		}
 
-		compressed_data.resize(zstream.total_out + sizeof(uncompressed_sz));
-		memcpy(compressed_data.data(), &uncompressed_sz, sizeof(uncompressed_sz));
+		auto& split = splits[job.split];
+		auto data = elf.sections[job.section].data.view();
+		size_t start = job.block * split.block_size;
+		auto in = data.subspan(start, std::min(split.block_size, data.size() - start));
+		bool last = job.block == split.blocks.size() - 1;
+
+		//the end of the previous block is this one's dictionary, so matches
+		//can still reach back across the join
+		auto& block = split.blocks[job.block];
+		uint32_t adler = 1, crc = 0;
+		bool deflated = backend::deflate_block(data.first(start), in, last, block, *settings[job.section],
+			[&](std::span<const uint8_t> piece) {
+				adler = adler32(adler, piece);
+				crc = ::rpx::crc32(crc, piece);
+			});
+		if (!deflated) block.clear();
+		split.adlers[job.block] = adler;
+		split.crcs[job.block] = crc;
+
+		if (--blocks_left[job.split] == 0) {
+			if (!join_split_section(elf, split, *settings[split.index], options, cache_added)) failed = true;
+			if (section_done) section_done(split.index);
+		}
+	}, options.threads, options.parallel_for);
 
-		deflateEnd(&zstream);
+	if (cache_added) options.cache->trim_if_due();
+	return !failed;
+}
 
-		//not really sure how the original tool does this, but it sure does
-		if (compressed_data.size() >= section.data.size()) continue;
+bool rpx::compress(rpx& elf, const compress_options& options) {
+	RPX_TIMER(timer, compress, stage_event::whole_stage);
+	RPX_TIMER_BYTES_IN(timer, rpx_data_bytes(elf));
 
-		compressed_data.shrink_to_fit();
-		section.data = std::move(compressed_data);
+	bool ok = rpx_compress_sections(elf, options, nullptr);
+	RPX_TIMER_BYTES_OUT(timer, rpx_data_bytes(elf));
 
-		//we compressed this section, so update the flag
-		shdr.sh_flags |= SHF_RPL_ZLIB;
-		shdr.sh_size = (uint32_t)section.data.size();
+	//only once every section is done
+	relink(elf);
+	return ok;
+}
+
+const section_data& rpx::section_contents(rpx& elf, size_t section) {
+	auto& s = elf.sections[section];
+	if (s.hdr.sh_flags & SHF_RPL_ZLIB) rpx_decompress_section(elf, section, true);
+	return s.data;
+}
+
+uint32_t rpx::uncompressed_size(const rpx::Section& section) {
+	//sections without data (i.e. .bss) only have a size in the header
+	if (!section.hdr.sh_offset) return section.hdr.sh_size;
+
+	if (section.hdr.sh_flags & SHF_RPL_ZLIB && section.data.size() >= sizeof(uint32_t)) {
+		be2_val<uint32_t> uncompressed_sz;
+		memcpy(&uncompressed_sz, section.data.view().data(), sizeof(uncompressed_sz));
+		return uncompressed_sz;
 	}
+	return (uint32_t)section.data.size();
+}
 
-	relink(elf);
+std::string_view rpx::section_name(const rpx& elf, size_t section) {
+	size_t shstrndx = elf.ehdr.e_shstrndx.value();
+	if (shstrndx >= elf.sections.size() || section >= elf.sections.size()) return {};
+
+	const auto& shstrtab = elf.sections[shstrndx];
+	if (shstrtab.hdr.sh_flags & SHF_RPL_ZLIB) return {};
+
+	return rpx_string(shstrtab.data.view(), elf.sections[section].hdr.sh_name.value());
+}
+
+const char* rpx::compression_backend() {
+	return backend::name();
 }
@@ -0,0 +1,324 @@
+// Copyright (C) 2020 Ash Logan <ash@heyquark.com>
+// Licensed under the terms of the GNU GPL, version 3
+// http://www.gnu.org/licenses/gpl-3.0.txt
+
+#include "rpx.hpp"
+
+#include <cstdio>
+#include <cstdint>
+#include <string.h>
+#include <vector>
+#include <span>
+#include <algorithm>
+#include <atomic>
+#include "util.hpp"
+#include "internal.hpp"
+#include "parallel.hpp"
+#include "backend.hpp"
+#include "adler32.hpp"
+#include "instrumentation.hpp"
+
+using namespace rpx;
+using crc = be2_val<uint32_t>;
+
+namespace {
+
+//what a section is going to look like once it's been through compress()
+struct section_plan {
+	Elf32_Shdr hdr;
+	uint32_t crc32;
+	bool deflate;
+	//the section hasn't changed since decompress, so just write these
+	std::span<const uint8_t> original;
+	//the zlib stream, if it came out of the cache
+	std::vector<uint8_t> cached;
+	//if it's being deflated in blocks like compress() would, how big they
+	//are, and the adler32 for the end of the stream
+	size_t block_size = 0;
+	uint32_t adler = 1;
+};
+
+//one block of a split section, for the first go
+struct block_plan {
+	size_t section;
+	size_t block;
+	size_t size = 0;
+	uint32_t adler = 1;
+	uint32_t crc = 0;
+	bool ok = false;
+};
+
+//keeps track of where we are, so we can pad forwards instead of seeking
+struct forward_writer {
+	std::ostream& os;
+	uint64_t pos = 0;
+
+	void write(const void* data, size_t len) {
+		os.write((const char*)data, len);
+		pos += len;
+	}
+	void pad_to(uint64_t target) {
+		static const char zeroes[0x400] = { 0 };
+		while (pos < target) {
+			auto len = (size_t)std::min<uint64_t>(target - pos, sizeof(zeroes));
+			write(zeroes, len);
+		}
+	}
+};
+
+}
+
+void rpx::writerpx_compressed(const rpx& elf, std::ostream& os, const compress_options& options) {
+	RPX_TIMER(timer, writerpx, stage_event::whole_stage);
+	RPX_TIMER_BYTES_IN(timer, rpx_data_bytes(elf));
+	auto settings = rpx_section_settings(elf, options);
+
+	//first go: work out sizes and crcs. the deflated data goes nowhere, we just
+	//need to know how big it'll be for the section headers
+	std::vector<section_plan> plan(elf.sections.size());
+	std::atomic<bool> cache_added = false;
+	auto plan_section = [&](size_t i) {
+		const auto& section = elf.sections[i];
+		auto& p = plan[i];
+		p.hdr = section.hdr;
+		p.crc32 = section.crc32;
+		p.deflate = false;
+		p.block_size = 0;
+		if (!p.hdr.sh_offset) return;
+		RPX_TIMER(section_timer, compress, i);
+
+		auto data = section.data.view();
+		p.hdr.sh_size = (uint32_t)data.size();
+		RPX_TIMER_BYTES_IN(section_timer, data.size());
+		RPX_TIMER_BYTES_OUT(section_timer, data.size());
+
+		//same as compress()
+		if (options.reuse_unmodified && rpx_reusable(section)) {
+			p.original = section.original.view();
+			p.hdr.sh_flags |= SHF_RPL_ZLIB;
+			p.hdr.sh_size = (uint32_t)p.original.size();
+			RPX_TIMER_BYTES_OUT(section_timer, p.original.size());
+			return;
+		}
+		if (!rpx_compressible(p.hdr)) {
+			RPX_TIMER_CRC(section_timer, p.crc32 = crc32(0, data));
+			return;
+		}
+
+		//maybe it's been done before. a hit is kept for the second go, a miss
+		//gets collected on the way past and added
+		const section_cache* cache = nullptr;
+		std::string cache_key;
+		std::vector<uint8_t> fresh;
+		size_t compressed_sz;
+		if (options.cache && data.size() >= options.cache->min_section_size) {
+			cache = options.cache;
+			cache_key = cache->key(data, *settings[i]);
+			if (auto cached = cache->get(cache_key)) p.cached = std::move(*cached);
+		}
+		if (!p.cached.empty()) {
+			compressed_sz = p.cached.size();
+			RPX_TIMER_CRC(section_timer, p.crc32 = ::rpx::crc32(0, data));
+		} else {
+			//the crc goes along with the deflating, same as compress()
+			uint32_t section_crc = 0;
+			compressed_sz = backend::deflate_stream(data, *settings[i],
+				[&](std::span<const uint8_t> chunk) {
+					if (cache) fresh.insert(fresh.end(), chunk.begin(), chunk.end());
+				},
+				[&](std::span<const uint8_t> piece) {
+					RPX_TIMER_CRC(section_timer, section_crc = ::rpx::crc32(section_crc, piece));
+				});
+			if (!compressed_sz) {
+				RPX_TIMER_CRC(section_timer, p.crc32 = ::rpx::crc32(0, data));
+				return;
+			}
+			p.crc32 = section_crc;
+			if (cache) {
+				cache->put(cache_key, fresh);
+				cache_added = true;
+			}
+		}
+		//same rule as compress() - only keep it if it's smaller
+		if (compressed_sz + sizeof(crc) >= data.size()) {
+			p.cached = {};
+			return;
+		}
+
+		p.deflate = true;
+		p.hdr.sh_flags |= SHF_RPL_ZLIB;
+		p.hdr.sh_size = (uint32_t)(compressed_sz + sizeof(crc));
+		RPX_TIMER_BYTES_OUT(section_timer, p.hdr.sh_size.value());
+	};
+
+	//sections compress() would split get split here too, into the same blocks,
+	//so the output's the same. the blocks are all jobs of their own, like
+	//there.
+	std::vector<size_t> whole_sections;
+	std::vector<block_plan> blocks;
+	for (size_t i = 0; i < elf.sections.size(); i++) {
+		const auto& section = elf.sections[i];
+		size_t block_size = rpx_split_block_size(section, options);
+		if (!block_size) {
+			whole_sections.push_back(i);
+			continue;
+		}
+		plan[i].block_size = block_size;
+		size_t block_count = (section.data.size() + block_size - 1) / block_size;
+		for (size_t b = 0; b < block_count; b++) blocks.push_back({ i, b });
+	}
+	run_parallel(whole_sections.size() + blocks.size(), [&](size_t j) {
+		if (j < whole_sections.size()) return plan_section(whole_sections[j]);
+
+		auto& block = blocks[j - whole_sections.size()];
+		auto data = elf.sections[block.section].data.view();
+		size_t block_size = plan[block.section].block_size;
+		size_t start = block.block * block_size;
+		auto in = data.subspan(start, std::min(block_size, data.size() - start));
+		bool last = start + in.size() == data.size();
+
+		thread_local std::vector<uint8_t> scratch;
+		scratch.clear();
+		block.ok = backend::deflate_block(data.first(start), in, last, scratch, *settings[block.section],
+			[&](std::span<const uint8_t> piece) {
+				block.adler = adler32(block.adler, piece);
+				block.crc = ::rpx::crc32(block.crc, piece);
+			});
+		block.size = scratch.size();
+	}, options.threads, options.parallel_for);
+	if (cache_added) options.cache->trim_if_due();
+
+	//put the split sections back together, same as join_split_section
+	for (size_t b = 0; b < blocks.size();) {
+		size_t i = blocks[b].section;
+		auto& p = plan[i];
+		auto data = elf.sections[i].data.view();
+		//zlib header and adler32
+		size_t compressed_sz = 2 + sizeof(uint32_t);
+		uint32_t section_crc = 0;
+		bool ok = true;
+		for (; b < blocks.size() && blocks[b].section == i; b++) {
+			const auto& block = blocks[b];
+			size_t len = std::min(p.block_size, data.size() - block.block * p.block_size);
+			ok &= block.ok;
+			compressed_sz += block.size;
+			p.adler = adler32_combine(p.adler, block.adler, len);
+			section_crc = crc32_combine(section_crc, block.crc, len);
+		}
+		//shouldn't happen, but the normal way still works
+		if (!ok) {
+			plan_section(i);
+			continue;
+		}
+
+		p.hdr = elf.sections[i].hdr;
+		p.hdr.sh_size = (uint32_t)data.size();
+		p.crc32 = section_crc;
+		if (compressed_sz + sizeof(crc) >= data.size()) {
+			p.block_size = 0;
+			continue;
+		}
+		p.deflate = true;
+		p.hdr.sh_flags |= SHF_RPL_ZLIB;
+		p.hdr.sh_size = (uint32_t)(compressed_sz + sizeof(crc));
+	}
+
+	//build the crc table relink() would
+	auto crc_section = std::find_if(plan.begin(), plan.end(), [](const section_plan& p) {
+		return p.hdr.sh_type == SHT_RPL_CRCS;
+	});
+	std::vector<crc> crcs(elf.sections.size());
+	if (crc_section != plan.end()) {
+		crc_section->crc32 = 0;
+		crc_section->hdr.sh_size = (uint32_t)(crcs.size() * sizeof(crc));
+		std::vector<uint32_t> native_crcs(plan.size());
+		for (size_t i = 0; i < plan.size(); i++) native_crcs[i] = plan[i].crc32;
+		to_be(native_crcs, crcs);
+	}
+
+	//and the same layout too
+	uint32_t file_offset = elf.ehdr.e_shoff + elf.ehdr.e_shnum * elf.ehdr.e_shentsize;
+	bool first_section = true;
+	for (auto section_index : elf.section_file_order) {
+		auto& shdr = plan[section_index].hdr;
+		if (!shdr.sh_offset) continue;
+
+		if (!first_section) {
+			file_offset = alignup(file_offset, 0x40);
+		} else first_section = false;
+
+		shdr.sh_offset = file_offset;
+		file_offset += shdr.sh_size;
+	}
+
+	//second go: write it all out, front to back
+	forward_writer out { os };
+	out.write(&elf.ehdr, sizeof(elf.ehdr));
+
+	auto shdr_pad = elf.ehdr.e_shentsize - sizeof(Elf32_Shdr);
+	out.pad_to(elf.ehdr.e_shoff.value());
+	for (const auto& p : plan) {
+		out.write(&p.hdr, sizeof(p.hdr));
+		if (shdr_pad) out.pad_to(out.pos + shdr_pad);
+	}
+
+	for (auto section_index : elf.section_file_order) {
+		const auto& p = plan[section_index];
+		if (!p.hdr.sh_offset) continue;
+		RPX_TIMER(section_timer, writerpx, section_index);
+		out.pad_to(p.hdr.sh_offset.value());
+
+		auto data = elf.sections[section_index].data.view();
+		if (p.hdr.sh_type == SHT_RPL_CRCS) {
+			out.write(crcs.data(), crcs.size() * sizeof(crc));
+		} else if (!p.original.empty()) {
+			out.write(p.original.data(), p.original.size());
+		} else if (p.deflate) {
+			crc uncompressed_sz = (uint32_t)data.size();
+			out.write(&uncompressed_sz, sizeof(uncompressed_sz));
+
+			size_t compressed_sz;
+			if (!p.cached.empty()) {
+				out.write(p.cached.data(), p.cached.size());
+				compressed_sz = p.cached.size();
+			} else if (p.block_size) {
+				//the same blocks again, one at a time, with the header and
+				//adler32 compress() would put around them
+				uint8_t header[2];
+				rpx_zlib_header(*settings[section_index], header);
+				out.write(header, sizeof(header));
+				compressed_sz = sizeof(header);
+
+				std::vector<uint8_t> block;
+				for (size_t start = 0; start < data.size(); start += p.block_size) {
+					auto in = data.subspan(start, std::min(p.block_size, data.size() - start));
+					block.clear();
+					backend::deflate_block(data.first(start), in, start + in.size() == data.size(),
+						block, *settings[section_index]);
+					out.write(block.data(), block.size());
+					compressed_sz += block.size();
+				}
+
+				crc adler = p.adler;
+				out.write(&adler, sizeof(adler));
+				compressed_sz += sizeof(adler);
+			} else {
+				//deflate straight into the stream
+				compressed_sz = backend::deflate_stream(data, *settings[section_index],
+					[&](std::span<const uint8_t> chunk) {
+						out.write(chunk.data(), chunk.size());
+					}
+				);
+			}
+			if (compressed_sz + sizeof(crc) != p.hdr.sh_size) {
+				printf("WARN: section %zu changed size while compressing!\n", section_index);
+			}
+		} else {
+			out.write(data.data(), data.size());
+		}
+	}
+
+	//if file length is not aligned to 0x40, pad end of file
+	out.pad_to(alignup(out.pos, 0x40));
+	RPX_TIMER_BYTES_OUT(timer, out.pos);
+}
@@ -0,0 +1,370 @@
+// Copyright (C) 2020 Ash Logan <ash@heyquark.com>
+// Licensed under the terms of the GNU GPL, version 3
+// http://www.gnu.org/licenses/gpl-3.0.txt
+
+//batch (de)compressor for whole folders of rpx/rpl files. files are read on
+//one thread, (de)compressed on a work stealing pool and written out on
+//another, so the disk and the cpus are kept busy at the same time.
+
+#include "rpx.hpp"
+#include "work_stealing_pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+struct options {
+	bool compress = false;
+	unsigned int threads = 0;
+	//how much file data can be in memory at once
+	uint64_t memory_limit = 1024ull * 1024 * 1024;
+	std::optional<fs::path> out_dir;
+	rpx::compress_options compress_options;
+	std::vector<fs::path> inputs;
+};
+
+struct file_job {
+	fs::path in;
+	fs::path out;
+	uint64_t size;
+	//what it's been charged against the memory limit
+	uint64_t budget;
+	std::string data;
+	std::vector<uint8_t> result;
+};
+
+//blocks until there's room for another `bytes` of files in memory. a file
+//bigger than the whole limit still gets through, on its own.
+class memory_budget {
+public:
+	memory_budget(uint64_t limit) : limit(limit) {}
+
+	void acquire(uint64_t bytes) {
+		std::unique_lock lock(mutex);
+		freed.wait(lock, [&] { return used == 0 || used + bytes <= limit; });
+		used += bytes;
+	}
+	void release(uint64_t bytes) {
+		{
+			std::lock_guard lock(mutex);
+			used -= bytes;
+		}
+		freed.notify_all();
+	}
+
+private:
+	std::mutex mutex;
+	std::condition_variable freed;
+	uint64_t limit;
+	uint64_t used = 0;
+};
+
+//finished files waiting for the writer thread
+class write_queue {
+public:
+	void push(std::unique_ptr<file_job> job) {
+		{
+			std::lock_guard lock(mutex);
+			jobs.push(std::move(job));
+		}
+		ready.notify_one();
+	}
+	void close() {
+		{
+			std::lock_guard lock(mutex);
+			closed = true;
+		}
+		ready.notify_one();
+	}
+	//nullptr once it's closed and empty
+	std::unique_ptr<file_job> pop() {
+		std::unique_lock lock(mutex);
+		ready.wait(lock, [&] { return closed || !jobs.empty(); });
+		if (jobs.empty()) return nullptr;
+		auto job = std::move(jobs.front());
+		jobs.pop();
+		return job;
+	}
+
+private:
+	std::mutex mutex;
+	std::condition_variable ready;
+	std::queue<std::unique_ptr<file_job>> jobs;
+	bool closed = false;
+};
+
+struct stats {
+	std::atomic<size_t> files = 0;
+	std::atomic<size_t> failed = 0;
+	std::atomic<uint64_t> bytes_in = 0;
+	std::atomic<uint64_t> bytes_out = 0;
+};
+
+void usage(const char* argv0) {
+	printf("usage: %s [-d | -c] [options] <files or folders...>\n", argv0);
+	printf("  -d            decompress (default)\n");
+	printf("  -c            compress\n");
+	printf("  -o <folder>   write output here, keeping the folder structure,\n");
+	printf("                instead of replacing the input files\n");
+	printf("  -j <threads>  threads to use (default: all of them)\n");
+	printf("  -m <MiB>      rough limit on file data held in memory (default: 1024)\n");
+	printf("  -l <level>    deflate level when compressing, 0-9 (default: 6)\n");
+}
+
+//a whole number from min to max, or nothing (with a message) if that's not
+//what it is
+std::optional<long long> parse_number(const std::string& arg, const char* value, long long min, long long max) {
+	char* end;
+	errno = 0;
+	long long number = strtoll(value, &end, 0);
+	if (end == value || *end || errno == ERANGE || number < min || number > max) {
+		printf("%s needs a number from %lld to %lld!\n", arg.c_str(), min, max);
+		return std::nullopt;
+	}
+	return number;
+}
+
+std::optional<options> parse_args(int argc, char** argv) {
+	options opts;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		auto value = [&]() -> const char* {
+			if (i + 1 >= argc) {
+				printf("%s needs a value!\n", arg.c_str());
+				return nullptr;
+			}
+			return argv[++i];
+		};
+
+		if (arg == "-d") {
+			opts.compress = false;
+		} else if (arg == "-c") {
+			opts.compress = true;
+		} else if (arg == "-o") {
+			auto v = value();
+			if (!v) return std::nullopt;
+			opts.out_dir = v;
+		} else if (arg == "-j") {
+			auto v = value();
+			if (!v) return std::nullopt;
+			auto threads = parse_number(arg, v, 0, 1024);
+			if (!threads) return std::nullopt;
+			opts.threads = (unsigned int)*threads;
+		} else if (arg == "-m") {
+			auto v = value();
+			if (!v) return std::nullopt;
+			auto mib = parse_number(arg, v, 1, 1024 * 1024);
+			if (!mib) return std::nullopt;
+			opts.memory_limit = (uint64_t)*mib * 1024 * 1024;
+		} else if (arg == "-l") {
+			auto v = value();
+			if (!v) return std::nullopt;
+			auto level = parse_number(arg, v, 0, 9);
+			if (!level) return std::nullopt;
+			opts.compress_options.settings.level = (int)*level;
+		} else if (arg == "-h" || arg == "--help") {
+			return std::nullopt;
+		} else if (arg.starts_with("-") && arg.size() > 1) {
+			printf("unknown option %s!\n", arg.c_str());
+			return std::nullopt;
+		} else {
+			opts.inputs.push_back(arg);
+		}
+	}
+	if (opts.inputs.empty()) return std::nullopt;
+	return opts;
+}
+
+bool is_rpx(const fs::path& path) {
+	auto ext = path.extension().string();
+	std::transform(ext.begin(), ext.end(), ext.begin(), [](char c) { return (char)tolower(c); });
+	return ext == ".rpx" || ext == ".rpl";
+}
+
+//every file to do, with where it's going
+std::vector<std::unique_ptr<file_job>> find_files(const options& opts) {
+	std::vector<std::unique_ptr<file_job>> jobs;
+	auto add = [&](const fs::path& in, const fs::path& relative) {
+		auto job = std::make_unique<file_job>();
+		job->in = in;
+		job->out = opts.out_dir ? *opts.out_dir / relative : in;
+		std::error_code ec;
+		job->size = fs::file_size(in, ec);
+		if (ec) {
+			printf("%s: couldn't get size!\n", in.string().c_str());
+			return;
+		}
+		jobs.push_back(std::move(job));
+	};
+
+	for (const auto& input : opts.inputs) {
+		std::error_code ec;
+		if (fs::is_directory(input, ec)) {
+			for (auto it = fs::recursive_directory_iterator(input, ec); !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+				if (it->is_regular_file() && is_rpx(it->path())) {
+					add(it->path(), input.filename() / fs::relative(it->path(), input));
+				}
+			}
+		} else if (fs::exists(input, ec)) {
+			add(input, input.filename());
+		} else {
+			printf("%s: not found!\n", input.string().c_str());
+		}
+	}
+
+	//biggest first, so one giant file doesn't start last and hold everyone up
+	std::sort(jobs.begin(), jobs.end(), [](const auto& a, const auto& b) {
+		return a->size > b->size;
+	});
+	return jobs;
+}
+
+//the cpu part - runs on the pool, and spreads the sections over it too.
+//returns what went wrong, or nullptr if nothing did.
+const char* process(file_job& job, const options& opts, work_stealing_pool& pool) {
+	std::istringstream is(std::move(job.data));
+	auto elf = rpx::readrpx(is);
+	job.data = {};
+	if (!elf) return "not a valid rpx!";
+
+	auto parallel_for = [&pool](size_t count, const std::function<void(size_t)>& fn) {
+		pool.parallel_for(count, fn);
+	};
+	//anything already compressed gets inflated first, and then (with -c)
+	//deflated again with our settings
+	//a broken file doesn't get written over the original
+	if (!rpx::decompress(*elf, { .parallel_for = parallel_for, .keep_original = false })) {
+		return "failed to decompress!";
+	}
+	if (opts.compress) {
+		auto compress_opts = opts.compress_options;
+		compress_opts.parallel_for = parallel_for;
+		if (!rpx::compress(*elf, compress_opts)) return "failed to compress!";
+	}
+
+	job.result.resize(rpx::writerpxsize(*elf));
+	if (!rpx::writerpx(*elf, job.result)) return "couldn't lay out the output!";
+	return nullptr;
+}
+
+//write to a temporary file and rename it over the target, so a crash never
+//leaves half a file (or half an input, when converting in place)
+bool write_file(const file_job& job) {
+	std::error_code ec;
+	if (job.out.has_parent_path()) fs::create_directories(job.out.parent_path(), ec);
+
+	auto temp = job.out;
+	temp += ".tmp";
+	{
+		std::ofstream os(temp, std::ios::binary | std::ios::trunc);
+		os.write((const char*)job.result.data(), job.result.size());
+		if (!os) return false;
+	}
+	fs::rename(temp, job.out, ec);
+	if (ec) {
+		fs::remove(temp, ec);
+		return false;
+	}
+	return true;
+}
+
+}
+
+int main(int argc, char** argv) {
+	auto opts = parse_args(argc, argv);
+	if (!opts) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	auto jobs = find_files(*opts);
+	if (jobs.empty()) {
+		printf("no rpx/rpl files to do!\n");
+		return 1;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	work_stealing_pool pool(opts->threads);
+	memory_budget budget(opts->memory_limit);
+	write_queue writes;
+	stats totals;
+
+	auto fail = [&](const file_job& job, const char* why) {
+		printf("%s: %s\n", job.in.string().c_str(), why);
+		totals.failed++;
+	};
+
+	//the writer - gets files out of memory as fast as the disk allows
+	std::thread writer([&] {
+		while (auto job = writes.pop()) {
+			if (write_file(*job)) {
+				totals.files++;
+				totals.bytes_in += job->size;
+				totals.bytes_out += job->result.size();
+			} else {
+				fail(*job, "couldn't write output!");
+			}
+			budget.release(job->budget);
+		}
+	});
+
+	//the reader - this thread. reads ahead as far as the memory limit lets it
+	for (auto& job_ptr : jobs) {
+		//the file, plus room for it decompressed (usually 2-3x) and the output
+		job_ptr->budget = job_ptr->size * (opts->compress ? 5 : 4);
+		budget.acquire(job_ptr->budget);
+
+		std::ifstream is(job_ptr->in, std::ios::binary);
+		std::ostringstream contents;
+		contents << is.rdbuf();
+		if (!is) {
+			fail(*job_ptr, "couldn't read!");
+			budget.release(job_ptr->budget);
+			continue;
+		}
+		job_ptr->data = std::move(contents).str();
+
+		//std::function needs something copyable
+		auto job = std::shared_ptr<file_job>(std::move(job_ptr));
+		pool.submit([&, job] {
+			if (auto error = process(*job, *opts, pool)) {
+				fail(*job, error);
+				budget.release(job->budget);
+				return;
+			}
+			writes.push(std::make_unique<file_job>(std::move(*job)));
+		});
+	}
+
+	pool.wait_idle();
+	writes.close();
+	writer.join();
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	printf("%s %zu files (%zu failed) in %.2fs on %u threads\n",
+		opts->compress ? "compressed" : "decompressed",
+		totals.files.load(), totals.failed.load(), seconds, pool.size());
+	printf("  %.1f MB in, %.1f MB out - %.1f MB/s, %.1f files/s\n",
+		totals.bytes_in / 1e6, totals.bytes_out / 1e6,
+		totals.bytes_in / 1e6 / seconds, totals.files / seconds);
+
+	return totals.failed ? 1 : 0;
+}
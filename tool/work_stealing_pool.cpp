@@ -0,0 +1,134 @@
+// Copyright (C) 2020 Ash Logan <ash@heyquark.com>
+// Licensed under the terms of the GNU GPL, version 3
+// http://www.gnu.org/licenses/gpl-3.0.txt
+
+#include "work_stealing_pool.hpp"
+
+#include <algorithm>
+
+//which queue the current thread owns, if it's one of ours
+static thread_local const work_stealing_pool* current_pool = nullptr;
+static thread_local size_t current_index = 0;
+
+work_stealing_pool::work_stealing_pool(unsigned int count) {
+	if (count == 0) count = std::max(std::thread::hardware_concurrency(), 1u);
+
+	for (unsigned int i = 0; i < count; i++) queues.push_back(std::make_unique<queue>());
+	for (unsigned int i = 0; i < count; i++) threads.emplace_back([this, i] { worker(i); });
+}
+
+work_stealing_pool::~work_stealing_pool() {
+	wait_idle();
+	{
+		std::lock_guard lock(sleep_mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (auto& thread : threads) thread.join();
+}
+
+void work_stealing_pool::submit(std::function<void()> task) {
+	//workers keep their own tasks, everyone else spreads them around
+	size_t target = (current_pool == this) ? current_index : next_queue++ % queues.size();
+	{
+		std::lock_guard lock(queues[target]->mutex);
+		queues[target]->tasks.push_back(std::move(task));
+	}
+	{
+		std::lock_guard lock(sleep_mutex);
+		queued++;
+		pending++;
+	}
+	wake.notify_one();
+}
+
+std::function<void()> work_stealing_pool::take(size_t self) {
+	//our own newest first - it's the most likely to still be in cache
+	if (self < queues.size()) {
+		auto& own = *queues[self];
+		std::lock_guard lock(own.mutex);
+		if (!own.tasks.empty()) {
+			auto task = std::move(own.tasks.back());
+			own.tasks.pop_back();
+			queued--;
+			return task;
+		}
+	}
+	//then the oldest from anyone else
+	for (size_t i = 1; i <= queues.size(); i++) {
+		auto& victim = *queues[(self + i) % queues.size()];
+		std::lock_guard lock(victim.mutex);
+		if (!victim.tasks.empty()) {
+			auto task = std::move(victim.tasks.front());
+			victim.tasks.pop_front();
+			queued--;
+			return task;
+		}
+	}
+	return nullptr;
+}
+
+bool work_stealing_pool::run_one(size_t self) {
+	auto task = take(self);
+	if (!task) return false;
+	task();
+
+	bool now_idle;
+	{
+		std::lock_guard lock(sleep_mutex);
+		now_idle = --pending == 0;
+	}
+	if (now_idle) idle.notify_all();
+	return true;
+}
+
+void work_stealing_pool::worker(size_t self) {
+	current_pool = this;
+	current_index = self;
+	for (;;) {
+		if (run_one(self)) continue;
+
+		std::unique_lock lock(sleep_mutex);
+		wake.wait(lock, [&] { return stopping || queued > 0; });
+		if (stopping) return;
+	}
+}
+
+void work_stealing_pool::parallel_for(size_t count, const std::function<void(size_t)>& job) {
+	if (count == 0) return;
+
+	struct state {
+		std::atomic<size_t> next = 0;
+		size_t done = 0;
+		std::mutex mutex;
+		std::condition_variable finished;
+	};
+	auto s = std::make_shared<state>();
+	auto run = [s, count, &job] {
+		for (size_t i = s->next++; i < count; i = s->next++) {
+			job(i);
+			bool last;
+			{
+				std::lock_guard lock(s->mutex);
+				last = ++s->done == count;
+			}
+			if (last) s->finished.notify_all();
+		}
+	};
+
+	//one helper per other thread, at most - each grabs jobs until they're gone
+	size_t helpers = std::min<size_t>(count, queues.size()) - 1;
+	for (size_t i = 0; i < helpers; i++) submit(run);
+	run();
+
+	//every job's been handed out, so whoever has the last few is already on
+	//them. just wait - picking up other tasks here could mean a whole other
+	//file (and its own parallel_for) running on top of this one.
+	std::unique_lock lock(s->mutex);
+	s->finished.wait(lock, [&] { return s->done == count; });
+}
+
+void work_stealing_pool::wait_idle() {
+	std::unique_lock lock(sleep_mutex);
+	idle.wait(lock, [&] { return pending == 0; });
+}
@@ -0,0 +1,66 @@
+// Copyright (C) 2020 Ash Logan <ash@heyquark.com>
+// Licensed under the terms of the GNU GPL, version 3
+// http://www.gnu.org/licenses/gpl-3.0.txt
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//a thread pool where each thread has its own queue of tasks. threads work
+//through their own queue newest first, and when it runs dry they steal the
+//oldest task from someone else's. tasks started from a worker (i.e. the
+//sections of a file it's compressing) stay on that worker unless someone
+//else is idle.
+class work_stealing_pool {
+public:
+	//0 threads = one per hardware thread
+	explicit work_stealing_pool(unsigned int threads = 0);
+	~work_stealing_pool();
+	work_stealing_pool(const work_stealing_pool&) = delete;
+	work_stealing_pool& operator=(const work_stealing_pool&) = delete;
+
+	void submit(std::function<void()> task);
+
+	//runs job(0) .. job(count - 1) on the pool and returns once they're all
+	//done, taking jobs itself until there are none left. fits
+	//rpx::parallel_for_fn.
+	void parallel_for(size_t count, const std::function<void(size_t)>& job);
+
+	//waits for every task to finish, including ones submitted meanwhile
+	void wait_idle();
+
+	unsigned int size() const { return (unsigned int)queues.size(); }
+
+private:
+	struct queue {
+		std::mutex mutex;
+		std::deque<std::function<void()>> tasks;
+	};
+
+	void worker(size_t self);
+	//runs one task - our own newest, or someone else's oldest. returns false
+	//if there wasn't one.
+	bool run_one(size_t self);
+	std::function<void()> take(size_t self);
+
+	std::vector<std::unique_ptr<queue>> queues;
+	std::vector<std::thread> threads;
+
+	//for sleeping when there's nothing to do
+	std::mutex sleep_mutex;
+	std::condition_variable wake;
+	std::condition_variable idle;
+	//tasks sitting in a queue
+	std::atomic<size_t> queued = 0;
+	//tasks sitting in a queue or running
+	std::atomic<size_t> pending = 0;
+	std::atomic<size_t> next_queue = 0;
+	bool stopping = false;
+};